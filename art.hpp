@@ -0,0 +1,21 @@
+#include <memory>
+#include <string>
+
+#pragma once
+
+/**
+ * @file art.hpp
+ *
+*/
+
+/// Finished ASCII art, shared by every thread that shows it and never changed once it's made
+using ArtBuffer = std::shared_ptr<const std::string>;
+
+/// What a job ended with, so errors never have to be told apart from art by the text
+enum class ArtStatus {
+    art, ///< It made ASCII art
+    no_file, ///< No image was chosen
+    unreadable, ///< The image couldn't be read
+    too_large, ///< The art is too large to be displayed on the screen
+    bad_scale, ///< The scale factor leaves no characters
+};
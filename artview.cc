@@ -0,0 +1,335 @@
+#include "artview.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/**
+ * @file artview.cc
+ *
+*/
+
+constexpr char first_glyph = ' '; ///< The first character in the atlas, which is never drawn
+constexpr int glyph_count = '~' - ' ' + 1; ///< The number of characters in the atlas, all of printable ASCII
+constexpr int min_cell = 1; ///< The narrowest a character can be zoomed to, in pixels
+constexpr int max_cell = 64; ///< The widest a character can be zoomed to, in pixels
+constexpr int reference_size = 64; ///< The font size glyphs are measured at before they're scaled to a cell
+
+/**
+ * @brief Finds a character in the atlas
+ *
+ * @param[in] c a character
+ * @return its place in ArtView::atlas, or 0 (a space) if it isn't printable ASCII
+ *
+*/
+static inline int glyph_index(char c) {
+    return (c > first_glyph && c < first_glyph + glyph_count) ? c - first_glyph : 0;
+}
+
+/**
+ * Sets up the viewport and its scrollbars, and the controllers
+ * that scroll and zoom it.
+ *
+*/
+ArtView::ArtView() : hscroll(), vscroll(), hadj(Gtk::Adjustment::create(0.0, 0.0, 0.0)),
+                     vadj(Gtk::Adjustment::create(0.0, 0.0, 0.0)), scroll(), pointer_x(0.0), pointer_y(0.0),
+                     text(), lines(), columns(0), cell_width(1), cell_height(1), aspect(1.0f),
+                     atlas(), atlas_width(0), atlas_height(0), frame() {
+    attach(area, 0, 0);
+    area.set_expand(true);
+    area.add_css_class("artview");
+    area.set_draw_func(sigc::mem_fun(*this, &ArtView::on_draw));
+    area.signal_resize().connect(sigc::mem_fun(*this, &ArtView::on_resize));
+
+    attach(hscroll, 0, 1);
+    hscroll.set_orientation(Gtk::Orientation::HORIZONTAL);
+    hscroll.set_adjustment(hadj);
+
+    attach(vscroll, 1, 0);
+    vscroll.set_orientation(Gtk::Orientation::VERTICAL);
+    vscroll.set_adjustment(vadj);
+
+    hadj->signal_value_changed().connect(sigc::mem_fun(area, &Gtk::DrawingArea::queue_draw));
+    vadj->signal_value_changed().connect(sigc::mem_fun(area, &Gtk::DrawingArea::queue_draw));
+
+    scroll = Gtk::EventControllerScroll::create();
+    scroll->set_flags(Gtk::EventControllerScroll::Flags::BOTH_AXES);
+    scroll->signal_scroll().connect(sigc::mem_fun(*this, &ArtView::on_scroll), false);
+    area.add_controller(scroll);
+
+    auto motion = Gtk::EventControllerMotion::create();
+    motion->signal_motion().connect(sigc::mem_fun(*this, &ArtView::on_motion));
+    area.add_controller(motion);
+}
+
+/**
+ * Shows some text. Every line gets a row of cells, so the cost
+ * here is one pass to find the lines, and drawing only ever
+ * touches the visible ones. If the text isn't the same size as
+ * the last text, it's zoomed so that it fits the area given, and
+ * the viewport asks for no more than that area. The text is kept
+ * by sharing it, so showing it never copies it.
+ *
+ * @param[in] text the text, with lines ending in '\\n'
+ * @param[in] aspect the height of a character divided by its width
+ * @param[in] fit_width the width to fit new art to, in pixels
+ * @param[in] fit_height the height to fit new art to, in pixels
+ *
+*/
+void ArtView::set_text(ArtBuffer text, float aspect, int fit_width, int fit_height) {
+    const int old_rows = lines.empty() ? 0 : (int)lines.size() - 1;
+    const int old_columns = columns;
+
+    this->text = text ? std::move(text) : std::make_shared<const std::string>();
+    const std::string &shown = *this->text;
+    lines.clear();
+    columns = 0;
+    std::size_t begin = 0;
+    while (begin < shown.size()) {
+        std::size_t end = shown.find('\n', begin);
+        if (end == std::string::npos) {
+            end = shown.size();
+        }
+        lines.push_back(begin);
+        columns = std::max(columns, (int)(end - begin));
+        begin = end + 1;
+    }
+    lines.push_back(begin);
+    while (lines.size() >= 2 && lines[lines.size()-1] - lines[lines.size()-2] <= 1) { // drop the blank lines at the end
+        lines.pop_back();
+    }
+    const int rows = (int)lines.size() - 1;
+
+    if (rows != old_rows || columns != old_columns || aspect != this->aspect) {
+        this->aspect = aspect;
+        int fit = std::min(fit_width / std::max(columns, 1), (int)(fit_height / (std::max(rows, 1) * aspect)));
+        cell_width = std::clamp(fit, min_cell, max_cell);
+        cell_height = std::max(1, (int)std::lround(cell_width * aspect));
+        hadj->set_value(0.0);
+        vadj->set_value(0.0);
+
+        area.set_content_width(std::min(columns * cell_width, fit_width));
+        area.set_content_height(std::min(rows * cell_height, fit_height));
+    }
+
+    update_adjustments();
+    area.queue_draw();
+}
+
+/**
+ * Returns the text being shown, which is empty if
+ * there is none.
+ *
+ * @return ArtView::text
+ *
+*/
+const std::string &ArtView::get_text() const {
+    static const std::string none;
+    return text ? *text : none;
+}
+
+/**
+ * Stops showing any text and frees it.
+ *
+*/
+void ArtView::clear() {
+    text.reset();
+    lines.clear();
+    columns = 0;
+    update_adjustments();
+    area.queue_draw();
+}
+
+/**
+ * Sets the ranges of the scrollbars to the size of the art at
+ * the current zoom, and their page size to the viewport.
+ *
+*/
+void ArtView::update_adjustments() {
+    const int rows = lines.empty() ? 0 : (int)lines.size() - 1;
+    const int width = area.get_width();
+    const int height = area.get_height();
+
+    hadj->configure(hadj->get_value(), 0.0, (double)columns * cell_width, cell_width, width * 0.9, width);
+    vadj->configure(vadj->get_value(), 0.0, (double)rows * cell_height, cell_height, height * 0.9, height);
+}
+
+/**
+ * Renders every glyph into ArtView::atlas at the current cell
+ * size. The font is measured at reference_size and scaled, so
+ * each glyph fills its cell exactly and the aspect of the cell
+ * always matches the one the art was made for.
+ *
+*/
+void ArtView::build_atlas() {
+    if (atlas_width == cell_width && atlas_height == cell_height) {
+        return;
+    }
+
+    auto surface = Cairo::ImageSurface::create(Cairo::Surface::Format::A8, glyph_count * cell_width, cell_height);
+    auto cr = Cairo::Context::create(surface);
+    auto layout = Pango::Layout::create(cr);
+
+    Pango::FontDescription font("Monospace");
+    font.set_absolute_size(reference_size * PANGO_SCALE);
+    layout->set_font_description(font);
+    layout->set_text("M");
+    Pango::Rectangle ink, logical;
+    layout->get_pixel_extents(ink, logical);
+    const int glyph_width = std::max(logical.get_width(), 1);
+    const int glyph_height = std::max(logical.get_height(), 1);
+
+    cr->scale((double)cell_width / glyph_width, (double)cell_height / glyph_height);
+    for (int i = 1; i < glyph_count; i++) { // a space has nothing to draw
+        layout->set_text(std::string(1, (char)(first_glyph + i)));
+        cr->move_to((double)i * glyph_width, 0.0);
+        layout->show_in_cairo_context(cr);
+    }
+    surface->flush();
+
+    const int row_bytes = glyph_count * cell_width;
+    atlas.resize((std::size_t)row_bytes * cell_height);
+    for (int y = 0; y < cell_height; y++) {
+        std::memcpy(atlas.data() + (std::size_t)y * row_bytes, surface->get_data() + (std::size_t)y * surface->get_stride(),
+                    row_bytes);
+    }
+    atlas_width = cell_width;
+    atlas_height = cell_height;
+}
+
+/**
+ * Draws the art. The visible cells are worked out from the scroll
+ * position, and each one's glyph is copied out of ArtView::atlas
+ * into a mask the size of the viewport, which is then painted in
+ * the widget's color in one go. Cells that are scrolled out of view
+ * are never looked at.
+ *
+ * @param[in] cr the context to draw with
+ * @param[in] width the width of the viewport
+ * @param[in] height the height of the viewport
+ *
+*/
+void ArtView::on_draw(const Cairo::RefPtr<Cairo::Context> &cr, int width, int height) {
+    const int rows = lines.empty() ? 0 : (int)lines.size() - 1;
+    if (rows == 0 || width <= 0 || height <= 0) {
+        return;
+    }
+    build_atlas();
+
+    if (!frame || frame->get_width() != width || frame->get_height() != height) {
+        frame = Cairo::ImageSurface::create(Cairo::Surface::Format::A8, width, height);
+    }
+    frame->flush();
+    unsigned char *data = frame->get_data();
+    const int stride = frame->get_stride();
+    std::memset(data, 0, (std::size_t)stride * height);
+
+    const int left = (int)hadj->get_value();
+    const int top = (int)vadj->get_value();
+    const int first_row = top / cell_height;
+    const int last_row = std::min(rows, (top + height + cell_height - 1) / cell_height);
+    const int first_column = left / cell_width;
+    const int last_column = std::min(columns, (left + width + cell_width - 1) / cell_width);
+    const int atlas_stride = glyph_count * cell_width;
+
+    for (int r = first_row; r < last_row; r++) {
+        const char *line = text->data() + lines[r];
+        const int length = std::min<int>(last_column, lines[r+1] - lines[r] - 1);
+        const int y = r * cell_height - top;
+        const int y0 = std::max(0, -y); // the part of the cell inside the viewport
+        const int y1 = std::min(cell_height, height - y);
+
+        for (int c = first_column; c < length; c++) {
+            const int glyph = glyph_index(line[c]);
+            if (glyph == 0) {
+                continue;
+            }
+            const int x = c * cell_width - left;
+            const int x0 = std::max(0, -x);
+            const int x1 = std::min(cell_width, width - x);
+            const unsigned char *src = atlas.data() + glyph * cell_width;
+            for (int gy = y0; gy < y1; gy++) {
+                std::memcpy(data + (std::size_t)(y + gy) * stride + x + x0, src + (std::size_t)gy * atlas_stride + x0, x1 - x0);
+            }
+        }
+    }
+    frame->mark_dirty();
+
+    auto color = area.get_color();
+    cr->set_source_rgba(color.get_red(), color.get_green(), color.get_blue(), color.get_alpha());
+    cr->mask(frame, 0.0, 0.0);
+}
+
+/**
+ * Updates the scrollbars when the viewport is resized.
+ *
+ * @param[in] width the new width of the viewport
+ * @param[in] height the new height of the viewport
+ *
+*/
+void ArtView::on_resize(int width, int height) {
+    update_adjustments();
+}
+
+/**
+ * Scrolls by three characters per step of the wheel, or zooms
+ * in or out around the pointer if control is held.
+ *
+ * @param[in] dx how far to scroll horizontally
+ * @param[in] dy how far to scroll vertically
+ * @return true, because the scroll was handled
+ *
+*/
+bool ArtView::on_scroll(double dx, double dy) {
+    if ((scroll->get_current_event_state() & Gdk::ModifierType::CONTROL_MASK) == Gdk::ModifierType::CONTROL_MASK) {
+        if (dy < 0) {
+            set_zoom(std::max(cell_width + 1, cell_width * 5 / 4), pointer_x, pointer_y);
+        } else if (dy > 0) {
+            set_zoom(std::min(cell_width - 1, cell_width * 4 / 5), pointer_x, pointer_y);
+        }
+        return true;
+    }
+
+    hadj->set_value(hadj->get_value() + dx * cell_width * 3);
+    vadj->set_value(vadj->get_value() + dy * cell_height * 3);
+    return true;
+}
+
+/**
+ * Remembers where the pointer is, so zooming can keep
+ * the art under it in place.
+ *
+ * @param[in] x the x position of the pointer in the viewport
+ * @param[in] y the y position of the pointer in the viewport
+ *
+*/
+void ArtView::on_motion(double x, double y) {
+    pointer_x = x;
+    pointer_y = y;
+}
+
+/**
+ * Changes the size of a character, scrolling so that the
+ * art at x, y in the viewport stays there. Only the atlas is
+ * rendered again, at the new size, the next time it's drawn.
+ *
+ * @param[in] cell_width the new width of a character, clamped to min_cell-max_cell
+ * @param[in] x the x position in the viewport to zoom around
+ * @param[in] y the y position in the viewport to zoom around
+ *
+*/
+void ArtView::set_zoom(int cell_width, double x, double y) {
+    cell_width = std::clamp(cell_width, min_cell, max_cell);
+    if (cell_width == this->cell_width) {
+        return;
+    }
+
+    const double column = (hadj->get_value() + x) / this->cell_width;
+    const double row = (vadj->get_value() + y) / cell_height;
+    this->cell_width = cell_width;
+    cell_height = std::max(1, (int)std::lround(cell_width * aspect));
+
+    update_adjustments();
+    hadj->set_value(column * cell_width - x);
+    vadj->set_value(row * cell_height - y);
+    area.queue_draw();
+}
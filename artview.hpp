@@ -0,0 +1,60 @@
+#include <gtkmm.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "art.hpp"
+
+#pragma once
+
+/**
+ * @file artview.hpp
+ *
+*/
+
+/**
+ * @brief A widget that shows ASCII art
+ *
+ * A widget that draws ASCII art from an atlas of monospace glyphs
+ * that's rendered once for each zoom level. Only the rows and
+ * columns inside the viewport are drawn, so showing, scrolling
+ * and zooming cost the same however big the art is. Scroll to
+ * move around and hold control while scrolling to zoom.
+ *
+*/
+class ArtView : public Gtk::Grid {
+    public:
+        ArtView(); ///< The constructor for the ArtView class
+
+        /// A function to show art, fitting it to a fit_width by fit_height area if its size changed
+        void set_text(ArtBuffer text, float aspect, int fit_width, int fit_height);
+        const std::string &get_text() const; ///< A function that returns the text being shown
+        void clear(); ///< A function to stop showing any text
+
+    protected:
+        void on_draw(const Cairo::RefPtr<Cairo::Context> &cr, int width, int height); ///< A function to draw the visible cells
+        void on_resize(int width, int height); ///< A function called when the viewport changes size
+        bool on_scroll(double dx, double dy); ///< A function to scroll, or zoom if control is held
+        void on_motion(double x, double y); ///< A function to remember where the pointer is, to zoom around it
+
+        void set_zoom(int cell_width, double x, double y); ///< A function to zoom, keeping the point x, y in place
+        void update_adjustments(); ///< A function to fit ArtView::hadj and ArtView::vadj to the art and viewport
+        void build_atlas(); ///< A function to render the glyphs at the current zoom, if they aren't already
+
+        Gtk::DrawingArea area; ///< The viewport the art is drawn in
+        Gtk::Scrollbar hscroll, vscroll; ///< The scrollbars for the viewport
+        Glib::RefPtr<Gtk::Adjustment> hadj, vadj; ///< The scroll positions, in pixels
+        Glib::RefPtr<Gtk::EventControllerScroll> scroll; ///< Scrolls the viewport, and tells whether control is held
+        double pointer_x, pointer_y; ///< Where the pointer last was in the viewport
+
+        ArtBuffer text; ///< The text being shown, shared with whoever made it, empty if there's none
+        std::vector<std::size_t> lines; ///< Where each line of ArtView::text begins, plus one past the end of the last
+        int columns; ///< The length of the longest line
+
+        int cell_width; ///< The width of a character in pixels
+        int cell_height; ///< The height of a character in pixels
+        float aspect; ///< The height of a character divided by its width
+
+        std::vector<unsigned char> atlas; ///< The coverage of every glyph side by side, one byte per pixel
+        int atlas_width, atlas_height; ///< The cell size ArtView::atlas was rendered at, 0 if it hasn't been
+        Cairo::RefPtr<Cairo::ImageSurface> frame; ///< The mask the visible cells are copied into, reused between draws
+};
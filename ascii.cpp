@@ -15,11 +15,17 @@
 #include <thread>
 #include <vector>
 #include <map>
+#include <memory>
 #include <regex>
 
 #include "gui.hpp"
 #include "worker.hpp"
 #include "settings.hpp"
+#include "decoder.hpp"
+#include "stream.hpp"
+#include "glyphs.hpp"
+#include "batch.hpp"
+#include "frames.hpp"
 
 /**
  * @file ascii.cpp
@@ -32,8 +38,9 @@
  * @section intro_sec Introduction
  * 
  * This program is a simple ASCII art converter that takes an image file and
- * converts it to an ASCII art representation. It uses <a href="https://imagemagick.org">
- * ImageMagick </a> to convert the input image and <a href="https://www.gtk.org">Gtk</a>
+ * converts it to an ASCII art representation. It decodes the input image with
+ * GdkPixbuf, falling back to <a href="https://imagemagick.org">ImageMagick</a> for
+ * formats GdkPixbuf can't read, and uses <a href="https://www.gtk.org">Gtk</a>
  * (specifically <a href="https://www.gtkmm.org/en/index.html">gtkmm</a> for C++) for
  * the %GUI.
  *
@@ -49,355 +56,275 @@
  * You can gauge the progress by looking at the progress bar next to the run
  * button. If a bar is bouncing back and forth, the program is loading the
  * file. When the bar is full, your image should be displayed in the center of
- * the window. A commom problem is that the progress bar is full, but the text
- * is not being displayed. This should only happen for a few seconds and it's
- * the %GUI trying to display the text. Right above the image there are two options,
- * one to copy the text and another to save it to an RTF file. If you click
+ * the window. Scroll to move around the image, and hold control while scrolling
+ * to zoom in and out. Right above the image there are two options,
+ * one to copy the text and another to save it to a file. If you click
  * 'Copy Text', the text will be copied to your clipboard for you to paste
- * elsewhere. If you click 'Export as RTF', you will be prompted to save an
- * RTF file containing the image text. If you're not here, you can click the
+ * elsewhere. If you click 'Export', you will be prompted to save the image
+ * text as an RTF, plain text, HTML or ANSI file, picked by the extension you
+ * give it. If you're not here, you can click the
  * 'Help' button at the bottom of the window to get pretty much these exact
  * same instructions and access Advanced %Settings.
+ *
+ * @section cli_sec Command Line
+ *
+ * Given any arguments, the program converts images without opening a
+ * window, for scripts and large batches. Pass it images or directories
+ * of images, and each one is written to a text file with the same name,
+ * or into the directory given with '-o'. Run 'ascii --help' for the
+ * other options. Images are converted at the same time, and the threads
+ * that run out of images help with the big ones that are left.
+ * Animated GIF and WebP images play in the window, and '--play' plays
+ * them in the terminal instead, or '--raw' plays raw gray frames piped in
+ * from a video decoder. '--terminal' shows an image in the terminal and
+ * draws it again whenever the terminal is resized. Both only send the
+ * characters that changed, which keeps them smooth over SSH.
  * 
 */
 
 
-// `.':_,^=;><+!rc*/z?sLTv)J7|Fi{C}fI31tlu[neoZ5Yxa2EwkP6h9d4VOGbUAKXHm8RD#$Bg0MNWQ%&@
-
-/// An array of ASCII characters from dark to light, each repeated thrice
-constexpr char ascii_sub[255]={' ',' ',' ','`','`','`','.','.','.','\'', '\'', '\'', ':', ':', ':','_', '_', '_',',', ',', ',',
-'^', '^', '^','=', '=', '=',';', ';', ';','>','>', '>','<', '<', '<','+', '+', '+','!', '!',
-'!','r', 'r', 'r','c', 'c', 'c','*', '*', '*','/', '/', '/','z', 'z', 'z','?', '?', '?','s',
-'s', 's','L', 'L', 'L','T', 'T', 'T','v', 'v','v',')', ')', ')','J', 'J', 'J','7', '7', '7',
-'|', '|', '|','F', 'F', 'F','i', 'i', 'i','{','{', '{','C', 'C', 'C', '}', '}','f', 'f',
-'f','I', 'I', 'I','3', '3', '3','1', '1', '1','t', 't', 't','l', 'l', 'l','u', 'u', 'u','[',
-'[', '[','n', 'n', 'n','e', 'e', 'e','o', 'o','o','Z', 'Z', 'Z','5', '5', '5','Y', 'Y', 'Y',
-'x', 'x', 'x','j', 'j','y', 'y','a', 'a', 'a','2', '2', '2','E', 'E', 'E','w', 'w', 
-'w','k', 'k', 'k','P', 'P', 'P','6', '6', '6','h', 'h', 'h','9', '9', '9','d', 'd', 'd','4', 
-'4', '4','V', 'V', 'V','O', 'O', 'O','G', 'G', 'G','b', 'b', 'b','U', 'U', 'U','A', 'A', 'A',
-'K', 'K', 'K','X', 'X', 'X','H', 'H', 'H','m', 'm', 'm','8', '8', '8','R', 'R', 'R','D', 'D', 
-'D','#', '#', '#','$', '$', '$','B', 'B', 'B','g', 'g', 'g','0', '0', '0','M', 'M', 'M','N', 
-'N', 'N','W', 'W', 'W','Q', 'Q', 'Q','%', '%', '%','&', '&', '&','@', '@', '@'};
-// from stackoverflow (https://stackoverflow.com/questions/30097953/ascii-art-sorting-an-array-of-ascii-characters-by-brightness-levels-c-c)
-
 /**
- * @brief Sanitizes the input to prevent command injection
+ * @brief Does the conversion from image to ASCII
  *
- * Takes a file path and removes any characters that aren't
- * alphanumeric and semicolons.
+ * Takes a job with a file path to an image and a scale factor
+ * and converts the image to ASCII letters. Runs on the Worker's
+ * thread, and stops early if a newer job replaces this one.
  *
- * @param[in] input the file path string to sanitize
- * @return the sanitized input
+ * @param[in] job the file, scale factor, screen size and settings to convert with
  *
 */
-std::string sanitizeInput(std::string input) {
-    std::regex pattern("(?![A-Za-z0-9_.]+)(;)"); // matches anything that's not A-Z, a-z, 0-9, _, or . and explicitly matches ;
-    
-    input = std::regex_replace(input, pattern, "");
-
-    // a regex pattern that matches a space
-    std::regex space(" ");
-    input = std::regex_replace(input, space, "\\ "); // replace spaces with \ to escape them
+void Worker::work(const Job &job) {
+    const std::string &filename = job.filename;
+    const float scale_factor = job.scale_factor;
+    const Settings &s = job.settings; // a copy, so the settings window can't change it halfway through
 
-    return input;
-}
+    if (filename == "") { // if no file is selected, set message and return
+        fail(job, ArtStatus::no_file);
+        return;
+    }
 
-/**
- * @brief Creates a pgm file from an image file
- *
- * Takes a filename, sanitizes it with sanitizeInput(), and
- * uses ImageMagick to convert it to a .pgm file
- *
- * @attention The user must have ImageMagick installed
- *
- * @param[in] filename the name of the file to convert to a pgm file
- *
-*/
-void create_pgm(std::string filename) {
-    std::string sanitized = sanitizeInput(filename);
-    
-    std::string command = "magick " + sanitized + " -compress none out.pgm";
-    
-    std::system(command.c_str());
-}
+    pool.resize(s.threads);
 
-/**
- * Reads the pgm file and stores it in a string
- *
- * @param[in,out] image the string to store the pgm file in
- * @param[in,out] gui the GUI object to update the progress bar
- * @param[in,out] mutex the mutex to lock the progress bar
- *
-*/
-void get_pgm(std::string &image, GUI *gui, std::mutex &mutex) {
-    /*std::ifstream inimage("out.ppm");
-    std::stringstream file;
-    file << inimage.rdbuf();
-    inimage.close();
-    image = file.str();*/
-    // good code
+    const GlyphTable &glyphs = ramps.get(s.ramp, s.dark_mode); // built at compile time, or once for a new ramp
 
-    // bad code, but progressbar!
-    std::ifstream inimage("out.pgm");
-    std::string line;
-    int wait = 0;
-    gui->pulse_pbar();
+    // the size of the text for an image, and whether it's allowed on the screen
+    auto text_size = [&](int width, int height, int &destw, int &desth) {
+        destw = width/scale_factor;
+        desth = height/(scale_factor*s.char_aspect); // characters are taller than they are wide
+        return destw > 0 && desth > 0 && !((destw > job.swidth-50 || desth > job.sheight-280) && s.size_limit);
+    };
 
-    while (std::getline(inimage, line)) {
-        image += line + "\n";
-        wait++;
-        if (wait == 100) {
-            wait = 0;
-            gui->pulse_pbar();
+    ProgressFunc progress = [this](double frac) {
+        if (will_stop.cancelled()) { // check if the job should stop, without waiting for the mutex
+            return false;
+        }
+        report_progress(frac); // update the progress, the GUI reads it when it's next notified
+        return true;
+    };
+
+    std::unique_ptr<RowSource> source; // the rows of the image when it's streamed instead
+    int width = 0, height = 0; // image width and height
+
+    // work out which stages the last job left behind can be reused
+    Stage stage = Stage::decode;
+    FileId id;
+    if (!s.low_memory && !image.empty() && filename == image_filename && id.read(filename) && id == image_id) {
+        stage = Stage::scale;
+        if (scaled_job && scaled_job->scale_factor == scale_factor && stale_stage(scaled_job->settings, s) >= Stage::map) {
+            stage = Stage::map;
         }
     }
-}
 
-/**
- * @brief Trims the pgm file to get the width and height of the image,
- * along with the destination width and height
- *
- * Takes a string with the contents a .pgm file and various references
- * and removes the first 3 lines while getting the width and height
- *
- * @param[in] image the string to trim
- * @param[in,out] width the width of the image
- * @param[in,out] height the height of the image
- * @param[in,out] destw the destination width of the image
- * @param[in,out] desth the destination height of the image
- * @param[in] scale_factor the scale factor to scale the image by
- * @return the trimmed string
- *
-*/
-std::string trim_file(std::string image, int &width, int &height, int &destw, int &desth, float scale_factor) {
-    image.erase(0, 3); // erase the magic number
-
-    int space = image.find(' ');
-    int newline = image.find('\n');
-    if (space != std::string::npos) {
-        width = std::stoi(image.substr(0,space));
-        height = std::stoi(image.substr(space+1,newline));
+    // GIF and WebP files are opened as animations first, unless this version of the file was already found to be still
+    std::unique_ptr<FrameSource> frames;
+    if (s.animate && !s.low_memory && !(filename == still_filename && id.read(filename) && id == still_id)) {
+        report_loading();
+        frames = open_animation(filename, &will_stop);
+        if (will_stop.cancelled()) {
+            return;
+        }
+        if (!frames) {
+            still_filename = id.read(filename) ? filename : "";
+            still_id = id;
+        }
     }
-    image.erase(0, newline+5); // erase the weird '255' and 2 newlines
-
-    destw = width/scale_factor;
-    desth = height/scale_factor;
-
-    return image;
-}
-
-
-std::string filenamecache = "";
-
-/**
- * @brief Parses the pgm file and stores the luminance values in a 2D vector
- * 
- * Takes a string with the contents of a .pgm file and various references
- * and stores the luminance values in a 2D vector
- * 
- * @param[in,out] gui the GUI object to update the progress bar while working
- * @param[in] image the trimmed .pgm file string to parse
- * @param[in] width the width of the image
- * @param[in] height the height of the image
- * @param[in,out] mutex the mutex ??
- * @param[in,out] donefrac the fraction of the progress bar that's filled
- * @param[in] progress_frac the fraction to fill the progress bar by
- * @param[in,out] will_stop a boolean to stop running
- * @param[in,out] stopped a boolean to tell if the program is stopped
- * @return a 2D vector with the luminance values
- *
-*/
-std::vector<std::vector<int>> parse_file(GUI *gui, std::string image, int width, int height,
-                std::mutex &mutex, double &donefrac, double progress_frac, bool &will_stop, bool &stopped) {
-
-    std::vector<std::vector<int>> lum_map = {{}}; // 2D vector to store the luminance values
+    if (frames) { // animations are played, a frame at a time, until they end or a new job replaces this one
+        int destw, desth;
+        if (!text_size(frames->width(), frames->height(), destw, desth)) {
+            fail(job, destw > 0 && desth > 0 ? ArtStatus::too_large : ArtStatus::bad_scale);
+            return;
+        }
 
-    std::istringstream iss(image);
-    std::string token;
-    int heightcount = 0;
-    int widthcount = 0;
+        ArtBuffer last;
+        PlaybackStats stats;
+        bool ended = play_frames(*frames, destw, desth, s, ramps, 0.0, pool, &will_stop, [&](std::string &text) {
+            if (!last) {
+                report_playing(); // the first frame is ready, so the loading is over
+            }
+            last = std::make_shared<const std::string>(std::move(text)); // the next frame is mapped into a new buffer
+            finish(job, last, true);
+            return true;
+        }, stats);
+        report_playback(job, stats);
+        if (ended && last) {
+            finish(job, last);
+        }
+        return;
+    }
 
-    while (std::getline(iss, token, ' ')) { // get each number from the pgm file
-        if (widthcount == width) { // if the width has been reached
-            widthcount = 0; // reset width
-            lum_map.push_back(std::vector<int>{}); // add a new row to the image
-            heightcount++; // add one to the height
-            {
-                std::lock_guard<std::mutex> lock(mutex); // lock mutex and check if the program should stop
-                if (will_stop) {
-                    stopped = true;
-                    break;
+    DecodeStatus status = DecodeStatus::done;
+    if (stage == Stage::decode) {
+        report_loading();
+        image_filename.clear(); // whatever is resident is for a different image or version of it
+        image = LumImage();
+        sat.clear();
+        scaled_job.reset();
+        colors_filename.clear();
+        colors = RgbImage();
+        scaled_colors = RgbImage();
+
+        if (s.low_memory) { // stream the rows instead of decoding the whole image
+            source = open_row_source(filename, &will_stop);
+            if (source) {
+                width = source->width();
+                height = source->height();
+            }
+        } else {
+            if (!cache.load(filename, image, &will_stop)) { // only decode images that haven't been seen before
+                int fullw, fullh, destw, desth;
+                LumImage preview;
+                if (s.progressive && image_size(filename, fullw, fullh) && text_size(fullw, fullh, destw, desth) &&
+                    decode_preview(filename, destw, desth, preview)) { // show something while the whole image decodes
+                    auto text = std::make_shared<std::string>();
+                    if (map_glyphs(preview, glyphs, *text, pool, &will_stop)) {
+                        finish(job, std::move(text), true);
+                    }
                 }
 
-                donefrac += progress_frac; // update the progress
+                status = decode_image(filename, image, pool, progress);
+                if (status == DecodeStatus::done) { // saved once the art is shown, see Worker::run()
+                    store_filename = filename;
+                    store_budget = (std::size_t)s.cache_size << 20;
+                }
+            }
+            if (status == DecodeStatus::done && !image.empty() && id.read(filename)) {
+                image_filename = filename;
+                image_id = id;
             }
-            gui->notify();
-        }
-        widthcount++;
-        if (token == "\n" || token == " ") { // if the token is a newline or space, ignore it
-            continue;
         }
-        int num = std::stoi(token);
-        num = std::clamp(num, 0, 254); // clamp the number to 254 (the max value for the ascii array)
-        lum_map[heightcount].push_back(num); // add the color to the image
     }
-
-    return lum_map;
-}
-
-
-/**
- * @brief Does the conversion from image to ASCII
- *
- * Takes a file path to an image and a scale factor and
- * converts the image to ASCII letters.
- *
- * @param[in,out] gui the GUI object to update the progress bar while working
- * @param[in] filename the file path to the image to convert
- * @param[in] scale_factor the scale factor to scale the image by
- * @param[in] swidth the width of the screen
- * @param[in] sheight the height of the screen
- *
-*/
-void Worker::work(GUI *gui, std::string filename, float scale_factor, int swidth, int sheight, Settings &s) {
-    {
-        std::lock_guard<std::mutex> lock(mutex); // lock mutex and set variables
-        stopped = false;
-        donefrac = 0.0;
-        message = "";
+    if (!source) {
+        width = image.width();
+        height = image.height();
     }
 
-    if (filename == "") { // if no file is selected, set message and return
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            message = "-Please select an image";
-            stopped = true;
-        }
-        gui->notify();
+    if (status == DecodeStatus::stopped) { // if the job has been stopped, return
+        image = LumImage(); // it may be half decoded
         return;
     }
-    if (filenamecache != filename) { // generate a new pgm file if the filename has changed
-        filenamecache = filename;
-        create_pgm(filename);
+    if (status == DecodeStatus::failed || width == 0 || height == 0) { // if the image couldn't be read, set message and return
+        fail(job, ArtStatus::unreadable);
+        return;
     }
 
-    std::string image;
-    get_pgm(image, gui, mutex); // get the pgm file contents
+    int destw, desth;
+    bool fits = text_size(width, height, destw, desth);
 
-    int width, height, destw, desth; // image width and height
-
-    image = trim_file(image, width, height, destw, desth, scale_factor);
-
-    if ((destw > swidth-50 || desth > sheight-280) && s.size_limit) { // if the image is too large to display, set message and return
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            message = "-Image is too large to be displayed on the screen\nTry increasing the scale factor.";
-            stopped = true;
-        }
-        gui->notify();
+    if (!fits && destw > 0 && desth > 0) { // if the image is too large to display, set message and return
+        fail(job, ArtStatus::too_large);
         return;
     }
     if (destw <= 0 || desth <= 0) { // if the scale factor is invalid, set message and return
-        {
-            std::lock_guard<std::mutex> lock(mutex);
-            message = "-Invalid scale factor.";
-            std::cout << scale_factor << std::endl;
-            std::cout << destw << " " << desth << std::endl;
-            stopped = true;
-        }
-        gui->notify();
+        std::cout << scale_factor << std::endl;
+        std::cout << destw << " " << desth << std::endl;
+        fail(job, ArtStatus::bad_scale);
         return;
     }
 
-    if (stopped) { // if the program has been stopped, return
+    auto text = std::make_shared<std::string>(); // the mapping writes the art straight into the buffer the GUI shows
+
+    if (source) {
+        if (!convert_stream(*source, destw, desth, s.filter, glyphs, *text, progress)) { // stopped, or the stream ended early
+            fail(job, ArtStatus::unreadable); // dropped if it was stopped
+            return;
+        }
+        finish(job, std::move(text));
         return;
     }
 
-    double progress_frac = 1.0/height;
-    
-
-    std::vector<std::vector<int>> lum_map = {{}}; // 2D vector to store the luminance values
-
-    lum_map = parse_file(gui, image, width, height, mutex, donefrac, progress_frac, will_stop, stopped);
-
-    std::vector<std::vector<int>> scaled_lum_map(desth, std::vector<int>(destw));
-
-    if (scale_factor == 1.0) {
-        scaled_lum_map = lum_map;
-    } else {
-        // uses bilinear interpolation to scale the image
-        // https://chao-ji.github.io/jekyll/update/2018/07/19/BilinearResize.html
-        int v1, v2, v3, v4;
-        int xlow, xhigh, ylow, yhigh;
-        int px;
-        int xweight, yweight;
-        bool stop = false;
-
-        float xratio = (float)(width-1)/(destw-1);
-        float yratio = (float)(height-1)/(desth-1);
-
-        if (xratio * (destw-1) > width-1) {
-            xratio = (float)(width-2)/(destw-1);
+    // when matching shapes, every character needs a few pixels, not one
+    const int scaledw = s.shapes ? destw * shape_columns : destw;
+    const int scaledh = s.shapes ? desth * shape_rows : desth;
+
+    if (stage <= Stage::scale) {
+        scaled_job.reset();
+        scaled_colors = RgbImage(); // it was scaled with the old settings
+        // with the box filter, the summed-area table scales for the cost of the output alone
+        bool use_sat = s.filter == Filter::box;
+        if (use_sat && sat.empty() && !sat.build(image.view(), pool, &will_stop)) {
+            return;
         }
-        if (yratio * (desth-1) > height-1) {
-            yratio = (float)(height-2)/(desth-1);
-        }
-
-        for (int h = 0; h < desth; h++) {
-            for (int w = 0; w < destw; w++) {
-                xlow = (int)floor(w*xratio);
-                xhigh = (int)ceil(w*xratio);
-
-                ylow = (int)floor(h*yratio);
-                yhigh = (int)ceil(h*yratio);
-
-                xweight = (xratio * w) - xlow;
-                yweight = (yratio * h) - ylow;
-
-                v1 = lum_map[ylow][xlow];
-                v2 = lum_map[ylow][xhigh];
-                v3 = lum_map[yhigh][xlow];
-                v4 = lum_map[yhigh][xhigh];
-
-                px = v1 * (1 - xweight) * (1 - yweight) +
-                    v2 * xweight       * (1 - yweight) +
-                    v3 * (1 - xweight)       * yweight +
-                    v4 * xweight             * yweight;
-
-                scaled_lum_map[h][w] = px;
+        if (!use_sat || !sat.box_resample(scaledw, scaledh, scaled, pool, &will_stop)) { // the table's boxes can be too big
+            if (!Resampler(width, height, scaledw, scaledh, s.filter).resample(image.view(), scaled, pool, &will_stop)) {
+                return;
             }
         }
+        if (will_stop.cancelled()) { // scaled may be half done
+            return;
+        }
+        scaled_job = job;
     }
 
-    char ascii[255];
-    std::copy(std::begin(ascii_sub), std::end(ascii_sub), std::begin(ascii));
-    // copies the ascii_sub array to the ascii array
-
-    if (!s.dark_mode) {
-        std::reverse(std::begin(ascii), std::end(ascii));
+    bool mapped = s.shapes ? map_shapes(scaled, ramps.shapes(s.ramp, s.dark_mode), *text, pool, &will_stop)
+                           : map_glyphs(scaled, glyphs, *text, pool, &will_stop);
+    if (!mapped) {
+        return;
+    }
+    if (s.color == ColorMode::none) {
+        finish(job, std::move(text));
+        return;
     }
 
-    std::ostringstream oss;
-
-    for (auto row : scaled_lum_map) {
-        for (auto col : row) {
-            oss << ascii[col];
+    if (colors_filename != filename) { // the colors are only decoded the first time they're asked for
+        finish(job, text, true); // show the plain text while they decode
+        scaled_colors = RgbImage();
+        status = decode_color(filename, colors, pool, progress);
+        if (status == DecodeStatus::stopped) {
+            colors = RgbImage();
+            return;
+        }
+        if (status == DecodeStatus::done && colors.width() == width && colors.height() == height) {
+            colors_filename = filename;
+        } else { // the text can still be shown without them
+            colors = RgbImage();
+            finish(job, text);
+            return;
         }
-        oss << "\n";
     }
-    oss << std::endl;
 
-    {
-        std::lock_guard<std::mutex> lock(mutex);
-        will_stop = false;
-        stopped = true;
-        message = oss.str();
+    if (scaled_colors.width() != destw || scaled_colors.height() != desth) {
+        Resampler resampler(width, height, destw, desth, s.filter);
+        for (int c = 0; c < 3; c++) {
+            if (!resampler.resample(colors.planes[c].view(), scaled_colors.planes[c], pool, &will_stop)) {
+                scaled_colors = RgbImage(); // a plane may be half done
+                return;
+            }
+        }
     }
-    gui->notify();
-}
 
+    ArtBuffer colored = std::make_shared<const std::string>(colorize(*text, scaled_colors, s.color, s.dark_mode));
+    finish(job, std::move(text), false, std::move(colored));
+}
 
 int main(int argc, char *argv[]) {
+    if (argc > 1) { // any arguments mean the command line, which never starts Gtk
+        BatchOptions options;
+        if (!parse_batch_args(argc, argv, options)) {
+            return 2;
+        }
+        return run_batch(options);
+    }
+
     auto app = Gtk::Application::create("org.gtkmm.example");
 
     /// Shows the window and returns when it is closed.
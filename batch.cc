@@ -0,0 +1,756 @@
+#include "batch.hpp"
+#include "decoder.hpp"
+#include "glyphs.hpp"
+#include "resample.hpp"
+#include "threadpool.hpp"
+#include "color.hpp"
+#include "frames.hpp"
+#include "terminal.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <csignal>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+/**
+ * @file batch.cc
+ *
+*/
+
+/// The help text for the command line
+static const char usage[] =
+    "Usage: ascii [options] <images or directories>...\n"
+    "Converts images to ASCII art without opening a window. Directories are\n"
+    "searched for images, and each one is written to a text file with the\n"
+    "same name.\n"
+    "\n"
+    "Options:\n"
+    "  -s, --scale N        the scale factor, the higher it is the smaller the text (default 1,\n"
+    "                       or the size of the terminal when showing or playing there)\n"
+    "  -a, --aspect N       how much taller than wide a character is (default 1)\n"
+    "  -r, --ramp CHARS     the characters to draw with, from the least ink to the most\n"
+    "  -f, --filter NAME    area, bilinear or lanczos (default area)\n"
+    "  -c, --color MODE     none, ansi24, ansi256 or html (default none)\n"
+    "  -d, --dark           make the text for light characters on a dark background\n"
+    "  -m, --shapes         pick characters by the shape of the pixels they cover\n"
+    "  -o, --output DIR     write the text to DIR instead of next to each image\n"
+    "  -j, --threads N      the number of threads to use (default one per core)\n"
+    "  -t, --terminal       show an image in the terminal, refitted when it's resized ('+' and '-'\n"
+    "                       zoom, '0' fits it again, 'q' quits)\n"
+    "  -p, --play           play an animated GIF or WebP image in the terminal\n"
+    "      --raw WxH        play raw 8-bit gray frames of W by H pixels, from a file or '-' for stdin\n"
+    "      --fps N          the frames per second to play at (default the animation's own, or 30 for raw frames)\n"
+    "  -h, --help           show this help\n";
+
+/// The extensions of the files that are picked up from directories, in lower case
+static const char *const image_extensions[] = {".png", ".jpg", ".jpeg", ".gif", ".bmp", ".webp", ".tif", ".tiff",
+                                                ".ico", ".svg", ".pgm", ".ppm", ".pnm"};
+
+/// One image to convert
+struct BatchFile {
+    std::string path; ///< The file path to the image
+    std::uintmax_t size; ///< The size of the file in bytes
+};
+
+/**
+ * @brief Prints a problem with the command line
+ *
+ * @param[in] message what was wrong
+ * @return false, to return from parse_batch_args()
+ *
+*/
+static bool bad_args(const std::string &message) {
+    std::cerr << "ascii: " << message << "\n\n" << usage;
+    return false;
+}
+
+/**
+ * @brief Reads a whole argument as a number
+ *
+ * @param[in] text the argument, or nullptr if there wasn't one
+ * @param[out] value the number
+ * @return false if text isn't a number greater than 0
+ *
+*/
+static bool parse_number(const char *text, float &value) {
+    if (!text) {
+        return false;
+    }
+    char *end;
+    value = std::strtof(text, &end);
+    return end != text && *end == '\0' && value > 0;
+}
+
+/**
+ * Reads the options and the images to convert. Anything that
+ * doesn't start with '-' is an image or a directory.
+ *
+ * @param[in] argc the number of arguments, including the program name
+ * @param[in] argv the arguments
+ * @param[out] options the options that were read
+ * @return false if the arguments couldn't be read, after printing why
+ *
+*/
+bool parse_batch_args(int argc, char *argv[], BatchOptions &options) {
+    Settings &settings = options.settings;
+    settings.size_limit = false; // there's no screen to fit
+    settings.progressive = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr; // the argument after an option that takes one
+        float number;
+
+        if (arg == "-h" || arg == "--help") {
+            options.help = true;
+            return true;
+        } else if (arg == "-d" || arg == "--dark") {
+            settings.dark_mode = true;
+        } else if (arg == "-m" || arg == "--shapes") {
+            settings.shapes = true;
+        } else if (arg == "-s" || arg == "--scale") {
+            if (!parse_number(value, options.scale_factor)) {
+                return bad_args(arg + " needs a number greater than 0");
+            }
+            i++;
+        } else if (arg == "-a" || arg == "--aspect") {
+            if (!parse_number(value, settings.char_aspect)) {
+                return bad_args(arg + " needs a number greater than 0");
+            }
+            i++;
+        } else if (arg == "-j" || arg == "--threads") {
+            if (!parse_number(value, number)) {
+                return bad_args(arg + " needs a number greater than 0");
+            }
+            settings.threads = std::max(1, (int)number);
+            i++;
+        } else if (arg == "-r" || arg == "--ramp") {
+            if (!value) {
+                return bad_args(arg + " needs some characters");
+            }
+            settings.ramp = value;
+            i++;
+        } else if (arg == "-o" || arg == "--output") {
+            if (!value) {
+                return bad_args(arg + " needs a directory");
+            }
+            options.output = value;
+            i++;
+        } else if (arg == "-f" || arg == "--filter") {
+            const std::string name = value ? value : "";
+            if (name == "area") {
+                settings.filter = Filter::box;
+            } else if (name == "bilinear") {
+                settings.filter = Filter::bilinear;
+            } else if (name == "lanczos") {
+                settings.filter = Filter::lanczos;
+            } else {
+                return bad_args(arg + " needs area, bilinear or lanczos");
+            }
+            i++;
+        } else if (arg == "-c" || arg == "--color") {
+            const std::string name = value ? value : "";
+            if (name == "none") {
+                settings.color = ColorMode::none;
+            } else if (name == "ansi24") {
+                settings.color = ColorMode::ansi24;
+            } else if (name == "ansi256") {
+                settings.color = ColorMode::ansi256;
+            } else if (name == "html") {
+                settings.color = ColorMode::html;
+            } else {
+                return bad_args(arg + " needs none, ansi24, ansi256 or html");
+            }
+            i++;
+        } else if (arg == "-t" || arg == "--terminal") {
+            options.terminal = true;
+        } else if (arg == "-p" || arg == "--play") {
+            options.play = true;
+        } else if (arg == "--raw") {
+            char end;
+            if (!value || std::sscanf(value, "%dx%d%c", &options.raw_width, &options.raw_height, &end) != 2 ||
+                options.raw_width <= 0 || options.raw_height <= 0) {
+                return bad_args(arg + " needs a size like 640x360");
+            }
+            options.play = true;
+            i++;
+        } else if (arg == "--fps") {
+            if (!parse_number(value, number)) {
+                return bad_args(arg + " needs a number greater than 0");
+            }
+            options.fps = number;
+            i++;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return bad_args("unknown option " + arg);
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    if (options.inputs.empty()) {
+        return bad_args("no images to convert");
+    }
+    if (options.play && options.inputs.size() > 1) {
+        return bad_args("only one animation can be played at a time");
+    }
+    if (options.terminal && options.inputs.size() > 1) {
+        return bad_args("only one image can be shown in the terminal at a time");
+    }
+    return true;
+}
+
+/**
+ * @brief Adds an image, or every image in a directory, to the list
+ *
+ * Files named on the command line are always added, but only files
+ * with one of the image_extensions are taken from directories.
+ *
+ * @param[in] input a file or directory from the command line
+ * @param[in,out] files the images to convert
+ * @return false if input couldn't be read, after printing why
+ *
+*/
+static bool collect_files(const std::string &input, std::vector<BatchFile> &files) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+
+    if (!fs::is_directory(input, error)) {
+        std::uintmax_t size = fs::file_size(input, error);
+        if (error) {
+            std::cerr << "ascii: " << input << ": " << error.message() << std::endl;
+            return false;
+        }
+        files.push_back({input, size});
+        return true;
+    }
+
+    for (fs::recursive_directory_iterator it(input, fs::directory_options::skip_permission_denied, error), end;
+         !error && it != end; it.increment(error)) {
+        if (!it->is_regular_file(error)) {
+            continue;
+        }
+        std::string extension = it->path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (std::find(std::begin(image_extensions), std::end(image_extensions), extension) == std::end(image_extensions)) {
+            continue;
+        }
+        std::uintmax_t size = it->file_size(error);
+        if (!error) {
+            files.push_back({it->path().string(), size});
+        }
+    }
+
+    if (error) {
+        std::cerr << "ascii: " << input << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Works out where the text for an image goes
+ *
+ * @param[in] filename the file path to the image
+ * @param[in] options the options, for the output directory and color mode
+ * @return the image's path with the extension for the text, in the output directory if there is one
+ *
+*/
+static std::string output_path(const std::string &filename, const BatchOptions &options) {
+    std::filesystem::path path(filename);
+    switch (options.settings.color) {
+        case ColorMode::ansi24:
+        case ColorMode::ansi256:
+            path.replace_extension(".ans");
+            break;
+        case ColorMode::html:
+            path.replace_extension(".html");
+            break;
+        case ColorMode::none:
+            path.replace_extension(".txt");
+            break;
+    }
+    if (!options.output.empty()) {
+        path = std::filesystem::path(options.output) / path.filename();
+    }
+    return path.string();
+}
+
+/**
+ * @brief Makes sure no two images are written to the same file
+ *
+ * The text for an image is named after the image without its
+ * extension, so photo.png and photo.jpg, or a/x.png and b/x.png
+ * with an output directory, would be written to the same file at
+ * the same time, and one would silently replace the other. An image
+ * given twice is only converted once. Any other clash is an error
+ * that lists the images, and nothing is converted.
+ *
+ * @param[in,out] files the images to convert, without the ones given twice when it returns
+ * @param[in] options the options, for the output directory and color mode
+ * @return false if two different images would be written to the same file
+ *
+*/
+static bool check_outputs(std::vector<BatchFile> &files, const BatchOptions &options) {
+    std::map<std::string, std::vector<std::string>> sources; // every output file and the images written to it
+    std::vector<BatchFile> unique;
+    for (const BatchFile &file : files) {
+        std::vector<std::string> &images = sources[std::filesystem::path(output_path(file.path, options)).lexically_normal().string()];
+        const std::string image = std::filesystem::path(file.path).lexically_normal().string();
+        if (std::find(images.begin(), images.end(), image) != images.end()) {
+            continue; // given twice
+        }
+        images.push_back(image);
+        unique.push_back(file);
+    }
+    files = std::move(unique);
+
+    bool ok = true;
+    for (const auto &[output, images] : sources) {
+        if (images.size() < 2) {
+            continue;
+        }
+        ok = false;
+        std::cerr << "ascii: these images would all be written to " << output << ":" << std::endl;
+        for (const std::string &image : images) {
+            std::cerr << "    " << image << std::endl;
+        }
+    }
+    if (!ok) {
+        std::cerr << "ascii: rename them or convert them into different directories with -o" << std::endl;
+    }
+    return ok;
+}
+
+/**
+ * @brief Converts one image and writes its text
+ *
+ * Runs as one task of the ThreadPool, and every stage splits
+ * itself into bands on the same pool, so threads that have run
+ * out of images help with the bands of the big ones. Each image
+ * is freed as soon as it's scaled, so no more than one image per
+ * thread is held at once.
+ *
+ * @param[in] filename the file path to the image
+ * @param[in] options the options to convert with
+ * @param[in] glyphs the character for every luminance value
+ * @param[in] shapes the character for every pattern, only used when matching shapes
+ * @param[in] pool the threads to split the stages across
+ * @param[out] error what went wrong, if anything did
+ * @return false if the image couldn't be converted or written
+ *
+*/
+static bool convert_file(const std::string &filename, const BatchOptions &options, const GlyphTable &glyphs,
+                            const ShapeTable &shapes, ThreadPool &pool, std::string &error) {
+    const Settings &s = options.settings;
+    const ProgressFunc progress = [](double frac) { return true; }; // nothing watches and nothing stops a batch
+
+    LumImage image;
+    if (decode_image(filename, image, pool, progress) != DecodeStatus::done || image.empty()) {
+        error = "could not read the image";
+        return false;
+    }
+    const int width = image.width();
+    const int height = image.height();
+
+    const float scale_factor = options.scale_factor > 0 ? options.scale_factor : 1;
+    const int destw = width / scale_factor;
+    const int desth = height / (scale_factor * s.char_aspect); // characters are taller than they are wide
+    if (destw <= 0 || desth <= 0) {
+        error = "the scale factor is too large for the image";
+        return false;
+    }
+
+    // when matching shapes, every character needs a few pixels, not one
+    const int scaledw = s.shapes ? destw * shape_columns : destw;
+    const int scaledh = s.shapes ? desth * shape_rows : desth;
+    LumImage scaled;
+    Resampler(width, height, scaledw, scaledh, s.filter).resample(image.view(), scaled, pool);
+    image = LumImage();
+
+    std::string text;
+    if (s.shapes) {
+        map_shapes(scaled, shapes, text, pool);
+    } else {
+        map_glyphs(scaled, glyphs, text, pool);
+    }
+
+    if (s.color != ColorMode::none) {
+        RgbImage colors, scaled_colors;
+        if (decode_color(filename, colors, pool, progress) != DecodeStatus::done ||
+            colors.width() != width || colors.height() != height) {
+            error = "could not read the colors of the image";
+            return false;
+        }
+        Resampler resampler(width, height, destw, desth, s.filter);
+        for (int c = 0; c < 3; c++) {
+            resampler.resample(colors.planes[c].view(), scaled_colors.planes[c], pool);
+            colors.planes[c] = LumImage();
+        }
+        text = colorize(text, scaled_colors, s.color, s.dark_mode);
+    }
+
+    std::ofstream out(output_path(filename, options), std::fstream::out | std::fstream::trunc | std::fstream::binary);
+    out << text;
+    out.close();
+    if (!out) {
+        error = "could not write " + output_path(filename, options);
+        return false;
+    }
+    return true;
+}
+
+/// The frames per second raw frames are played at if no rate is given
+constexpr double default_raw_fps = 30.0;
+
+/// Set when the user presses control-C in the terminal, so what's playing stops and can print how it went
+static CancelToken interrupted;
+
+/// Set when the terminal is resized, so the art is fitted to it again
+static std::atomic<bool> resized{false};
+
+/**
+ * @brief Asks whatever is shown in the terminal to stop
+ *
+ * @param[in] signal the signal, which is always SIGINT
+ *
+*/
+static void on_interrupt(int signal) {
+    interrupted.cancel(); // a lock-free atomic store, which is safe in a signal handler
+}
+
+/**
+ * @brief Notes that the terminal was resized
+ *
+ * @param[in] signal the signal, which is always SIGWINCH
+ *
+*/
+static void on_resize(int signal) {
+    resized.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Sets the handler for a signal
+ *
+ * Unlike std::signal(), system calls aren't restarted after the
+ * handler runs, so a wait for a key returns as soon as the terminal
+ * is resized.
+ *
+ * @param[in] signal the signal
+ * @param[in] handler the function to run, or SIG_DFL
+ *
+*/
+static void set_handler(int signal, void (*handler)(int)) {
+    struct sigaction action = {};
+    action.sa_handler = handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(signal, &action, nullptr);
+}
+
+/**
+ * @brief Works out the scale factor that fits an image to the terminal
+ *
+ * @param[in] width the width of the image
+ * @param[in] height the height of the image
+ * @param[in] char_aspect how much taller than wide a character is
+ * @param[in] columns the width of the terminal
+ * @param[in] rows the height of the terminal
+ * @return the smallest scale factor that makes the text no bigger than the terminal
+ *
+*/
+static float fit_scale(int width, int height, float char_aspect, int columns, int rows) {
+    return std::max((float)width / columns, height / (char_aspect * rows));
+}
+
+/**
+ * @brief Prints how much a TerminalRenderer saved over full repaints
+ *
+ * @param[in] renderer the renderer, after its last frame
+ *
+*/
+static void print_bandwidth(const TerminalRenderer &renderer) {
+    std::cerr << "Sent " << renderer.bytes_sent() / 1024.0 << " KB, "
+              << 100.0 * renderer.bytes_sent() / std::max<std::size_t>(renderer.bytes_full(), 1) << "% of full repaints"
+              << std::endl;
+}
+
+/**
+ * @brief Plays an animation in the terminal
+ *
+ * Each frame is drawn with a TerminalRenderer, which only sends
+ * the cells that changed since the last frame. Unless a scale
+ * factor was given, the frames are fitted to the terminal, and
+ * fitted again from the next frame on whenever it's resized. After
+ * a resize, the next frame is repainted in full. It plays until the frames run out or control-C is
+ * pressed, then prints how many frames were shown and dropped, how
+ * long they took and how much was sent.
+ *
+ * @param[in] options the animation or raw frames to play and the options to convert them with
+ * @return 0 if it played, 1 if it couldn't be opened
+ *
+*/
+static int play_in_terminal(const BatchOptions &options) {
+    const std::string &input = options.inputs[0];
+    const Settings &s = options.settings;
+
+    int fd = -1;
+    std::unique_ptr<FrameSource> frames;
+    if (options.raw_width > 0) {
+        fd = input == "-" ? STDIN_FILENO : open(input.c_str(), O_RDONLY);
+        frames = open_raw_frames(fd, options.raw_width, options.raw_height,
+                                 options.fps > 0 ? options.fps : default_raw_fps, &interrupted);
+    } else {
+        frames = open_animation(input);
+    }
+    if (!frames) {
+        std::cerr << "ascii: " << input << ": not an animation that can be played" << std::endl;
+        if (fd > STDIN_FILENO) {
+            close(fd);
+        }
+        return 1;
+    }
+
+    GlyphRamps ramps;
+    ThreadPool pool(s.threads);
+    PlaybackStats stats;
+    set_handler(SIGINT, on_interrupt);
+    set_handler(SIGWINCH, on_resize);
+    {
+        TerminalRenderer renderer(STDOUT_FILENO);
+        // the size of the text at the given scale factor, or fitted to the terminal as it is now
+        auto text_size = [&](int &destw, int &desth) {
+            int columns = 80, rows = 24;
+            renderer.size(columns, rows);
+            const float scale_factor = options.scale_factor > 0 ? options.scale_factor
+                                                                : fit_scale(frames->width(), frames->height(), s.char_aspect, columns, rows);
+            destw = std::max(1, (int)(frames->width() / scale_factor));
+            desth = std::max(1, (int)(frames->height() / (scale_factor * s.char_aspect))); // characters are taller than they are wide
+        };
+        int destw, desth;
+        text_size(destw, desth);
+
+        play_frames(*frames, destw, desth, s, ramps, options.fps, pool, &interrupted, [&renderer](const std::string &text) {
+            renderer.draw(text);
+            return true;
+        }, stats, [&](int &destw, int &desth) {
+            if (!resized.exchange(false, std::memory_order_relaxed)) {
+                return false;
+            }
+            renderer.invalidate(); // the terminal may have reflowed or cleared what was on it
+            if (options.scale_factor > 0) {
+                return false;
+            }
+            const int oldw = destw, oldh = desth;
+            text_size(destw, desth);
+            return destw != oldw || desth != oldh;
+        });
+
+        print_bandwidth(renderer);
+    }
+    set_handler(SIGINT, SIG_DFL);
+    set_handler(SIGWINCH, SIG_DFL);
+    if (fd > STDIN_FILENO) {
+        close(fd);
+    }
+
+    std::cerr << "Played " << stats.shown << " frames, dropped " << stats.dropped << ", latency " << stats.mean_latency
+              << " ms on average and " << stats.worst_latency << " ms at worst" << std::endl;
+    return 0;
+}
+
+/**
+ * @brief Shows an image in the terminal until it's closed
+ *
+ * The image is decoded once and kept, so fitting it to a resized
+ * terminal or zooming only scales and maps it again, and the
+ * TerminalRenderer only sends the cells that changed. Press '+' and
+ * '-' to zoom, '0' to fit the terminal again and 'q' or control-C
+ * to quit.
+ *
+ * @param[in] options the image to show and the options to convert it with
+ * @return 0 if it was shown, 1 if it couldn't be read
+ *
+*/
+static int view_in_terminal(const BatchOptions &options) {
+    const std::string &input = options.inputs[0];
+    const Settings &s = options.settings;
+
+    ThreadPool pool(s.threads);
+    LumImage image;
+    if (decode_image(input, image, pool, [](double frac) { return true; }) != DecodeStatus::done || image.empty()) {
+        std::cerr << "ascii: " << input << ": could not read the image" << std::endl;
+        return 1;
+    }
+
+    GlyphRamps ramps;
+    const GlyphTable &glyphs = ramps.get(s.ramp, s.dark_mode);
+    const ShapeTable no_shapes;
+    const ShapeTable &shapes = s.shapes ? ramps.shapes(s.ramp, s.dark_mode) : no_shapes;
+
+    bool keys = isatty(STDIN_FILENO); // whether keys can be read
+    termios saved;
+    if (keys && tcgetattr(STDIN_FILENO, &saved) == 0) { // read keys as they're pressed, without echoing them
+        termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    } else {
+        keys = false;
+    }
+    set_handler(SIGINT, on_interrupt);
+    set_handler(SIGWINCH, on_resize);
+
+    {
+        TerminalRenderer renderer(STDOUT_FILENO);
+        float zoom = 1.0f;
+        bool redraw = true;
+        LumImage scaled;
+        std::string text;
+
+        while (!interrupted.cancelled()) {
+            if (resized.exchange(false, std::memory_order_relaxed)) {
+                renderer.invalidate();
+                redraw = true;
+            }
+            if (redraw) {
+                int columns = 80, rows = 24;
+                renderer.size(columns, rows);
+                const float scale_factor = (options.scale_factor > 0 ? options.scale_factor
+                                                : fit_scale(image.width(), image.height(), s.char_aspect, columns, rows)) / zoom;
+                const int destw = std::max(1, (int)(image.width() / scale_factor));
+                const int desth = std::max(1, (int)(image.height() / (scale_factor * s.char_aspect)));
+                // when matching shapes, every character needs a few pixels, not one
+                const int scaledw = s.shapes ? destw * shape_columns : destw;
+                const int scaledh = s.shapes ? desth * shape_rows : desth;
+
+                Resampler(image.width(), image.height(), scaledw, scaledh, s.filter).resample(image.view(), scaled, pool);
+                if (s.shapes) {
+                    map_shapes(scaled, shapes, text, pool);
+                } else {
+                    map_glyphs(scaled, glyphs, text, pool);
+                }
+                renderer.draw(text);
+                redraw = false;
+            }
+
+            pollfd key_fd = {STDIN_FILENO, POLLIN, 0};
+            if (poll(&key_fd, keys ? 1 : 0, 100) <= 0) { // a resize or control-C ends the wait early
+                continue;
+            }
+            char key;
+            if (read(STDIN_FILENO, &key, 1) != 1) {
+                keys = false;
+                continue;
+            }
+            if (key == 'q') {
+                break;
+            } else if (key == '+' || key == '=') {
+                zoom *= 1.25f;
+                redraw = true;
+            } else if (key == '-') {
+                zoom /= 1.25f;
+                redraw = true;
+            } else if (key == '0') {
+                zoom = 1.0f;
+                redraw = true;
+            }
+        }
+
+        print_bandwidth(renderer);
+    }
+
+    set_handler(SIGINT, SIG_DFL);
+    set_handler(SIGWINCH, SIG_DFL);
+    if (keys) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+    return 0;
+}
+
+/**
+ * Finds every image, converts them all on one ThreadPool with a
+ * task per image, biggest first so a huge one doesn't start last,
+ * and prints how many images and megabytes of them were converted
+ * per second. Gtk is never started.
+ *
+ * @param[in] options the images and the options to convert them with
+ * @return 0 if every image was converted, 1 if any weren't
+ *
+*/
+int run_batch(const BatchOptions &options) {
+    if (options.help) {
+        std::cout << usage;
+        return 0;
+    }
+    if (options.play) {
+        return play_in_terminal(options);
+    }
+    if (options.terminal) {
+        return view_in_terminal(options);
+    }
+    const Settings &s = options.settings;
+
+    std::vector<BatchFile> files;
+    bool found = true;
+    for (const std::string &input : options.inputs) {
+        found = collect_files(input, files) && found;
+    }
+    if (files.empty()) {
+        std::cerr << "ascii: no images to convert" << std::endl;
+        return 1;
+    }
+    if (!check_outputs(files, options)) { // two tasks writing one file would corrupt it
+        return 1;
+    }
+    std::stable_sort(files.begin(), files.end(), [](const BatchFile &a, const BatchFile &b) { return a.size > b.size; });
+
+    if (!options.output.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(options.output, error);
+        if (error) {
+            std::cerr << "ascii: " << options.output << ": " << error.message() << std::endl;
+            return 1;
+        }
+    }
+
+    GlyphRamps ramps; // the tables are made before the threads start, since GlyphRamps is only for one thread
+    const GlyphTable &glyphs = ramps.get(s.ramp, s.dark_mode);
+    const ShapeTable no_shapes;
+    const ShapeTable &shapes = s.shapes ? ramps.shapes(s.ramp, s.dark_mode) : no_shapes;
+
+    ThreadPool pool(s.threads);
+    std::atomic<int> converted{0};
+    std::atomic<std::uintmax_t> bytes{0};
+    std::mutex log; // so the errors of two images don't mix
+    const auto start = std::chrono::steady_clock::now();
+
+    pool.run(files.size(), [&](int i) {
+        std::string error;
+        if (convert_file(files[i].path, options, glyphs, shapes, pool, error)) {
+            converted.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(files[i].size, std::memory_order_relaxed);
+        } else {
+            std::lock_guard<std::mutex> lock(log);
+            std::cerr << "ascii: " << files[i].path << ": " << error << std::endl;
+        }
+    });
+
+    const double seconds = std::max(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 1e-9);
+    std::cout << "Converted " << converted.load() << " of " << files.size() << " images in " << seconds << " s ("
+                << converted.load() / seconds << " images/s, " << bytes.load() / (seconds * (1 << 20)) << " MB/s)"
+                << std::endl;
+
+    return found && converted.load() == (int)files.size() ? 0 : 1;
+}
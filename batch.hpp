@@ -0,0 +1,37 @@
+#include <string>
+#include <vector>
+#include "settings.hpp"
+
+#pragma once
+
+/**
+ * @file batch.hpp
+ *
+*/
+
+/**
+ * @brief The options for converting images from the command line
+ *
+ * A structure that holds what the command line asked for. The
+ * settings that change the text are kept in a Settings, the same
+ * as a conversion in the %GUI.
+ *
+*/
+struct BatchOptions {
+    std::vector<std::string> inputs; ///< The images and directories of images to convert
+    std::string output; ///< The directory to write the text to, empty to write it next to each image
+    float scale_factor = 0; ///< The scale factor to scale every image by, 0 to fit the terminal, or 1 when writing files
+    Settings settings; ///< The settings to convert with
+    bool help = false; ///< Whether the help was asked for instead
+    bool terminal = false; ///< Whether to show one image in the terminal instead of writing text files
+    bool play = false; ///< Whether to play an animation in the terminal instead of writing text files
+    int raw_width = 0; ///< The width of the raw gray frames to play, 0 if the input is an image
+    int raw_height = 0; ///< The height of the raw gray frames to play
+    double fps = 0; ///< The frames per second to play at, 0 to use the animation's own timing
+};
+
+/// A function to read the command line into options, false if it couldn't be read
+bool parse_batch_args(int argc, char *argv[], BatchOptions &options);
+
+/// A function to convert every image the options name, returns the exit status
+int run_batch(const BatchOptions &options);
@@ -0,0 +1,742 @@
+#include "decoder.hpp"
+#include "exporter.hpp"
+#include "glyphs.hpp"
+#include "color.hpp"
+#include "resample.hpp"
+#include "sat.hpp"
+#include "settings.hpp"
+#include "stream.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @file bench.cc
+ *
+ * A benchmark of every stage of a conversion, built with 'make bench'.
+ * Each stage runs on its own, in a process of its own so its peak
+ * memory can be measured, on synthetic images from 0.3 to 100
+ * megapixels and on the images in images/. Then the whole conversion
+ * runs end to end. The results are printed as JSON, so runs on two
+ * versions can be compared. Run 'bench --help' for the options.
+ *
+ * Every result has the input, the stage, the size of the image and
+ * the time of the fastest run, with
+ *  - ns_per_pixel, the time over the pixels of the image
+ *  - mb_per_s, the bytes the stage reads over the time
+ *  - peak_rss_kb, the peak memory of the process that ran the stage,
+ *    including what it loaded before it was timed
+ *
+ * or an error instead, if the stage couldn't run.
+ *
+*/
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown" ///< The version being measured, set by the Makefile from git
+#endif
+
+/// The sizes of the synthetic images, in megapixels
+static const double synthetic_sizes[] = {0.3, 1, 4, 12, 25, 50, 100};
+
+/// The largest synthetic image that also gets a plain .pgm file, which takes about 4 bytes a pixel
+constexpr double plain_max_mp = 25;
+
+/// The width of the text the stream_cancel stages make, a few rows high, so each output row needs many source rows
+constexpr int cancel_columns = 16;
+
+/// The largest synthetic image the colorize stages run on, since colored text at a character a pixel takes tens of bytes a pixel
+constexpr double colorize_max_mp = 12;
+
+static const char usage[] =
+    "usage: bench [options] [image ...]\n"
+    "\n"
+    "Times every stage of a conversion on synthetic images and on the given images,\n"
+    "or the ones in images/ if none are given, and prints the results as JSON.\n"
+    "\n"
+    "options:\n"
+    "  -j, --threads N      the threads to split each stage across (default: every core)\n"
+    "  -r, --repeat N       run each stage N times and keep the fastest (default: 3)\n"
+    "  -m, --max-mp N       skip synthetic images over N megapixels (default: 100)\n"
+    "  -c, --columns N      the width of the text the scaling stages make (default: 300)\n"
+    "  -h, --help           show this message\n";
+
+/// The options the benchmark was run with
+struct BenchConfig {
+    std::vector<std::string> files; ///< The images to run on besides the synthetic ones
+    int threads = std::max(1u, std::thread::hardware_concurrency()); ///< The threads each stage is split across
+    int repeat = 3; ///< How many times each stage runs
+    double max_mp = 100; ///< The largest synthetic image, in megapixels
+    int columns = 300; ///< The width of the text the scaling stages make
+};
+
+/**
+ * @brief An image to run the stages on
+ *
+ * A synthetic image has a binary .pgm file, a binary .ppm file for
+ * color and, if it's small enough, a plain .pgm file, all with the
+ * same pixels. An image from disk is used for all of them.
+ *
+*/
+struct Input {
+    std::string name; ///< What the results call it
+    double megapixels = 0.0; ///< The size of a synthetic image, 0 for an image from disk
+    std::string gray; ///< The file to decode luminance from
+    std::string color; ///< The file to decode colors from
+    std::string plain; ///< The plain .pgm file, empty if there isn't one
+};
+
+/// How one stage ran, as the process that ran it reports it
+struct Measurement {
+    bool ok = false; ///< Whether every run of the stage worked
+    double seconds = 0.0; ///< The time of the fastest run
+    double bytes = 0.0; ///< The bytes the stage reads
+    int width = 0; ///< The width of the image
+    int height = 0; ///< The height of the image
+};
+
+/**
+ * @brief Everything the stages work on
+ *
+ * A structure that loads what a stage needs before it's timed,
+ * only when it's first asked for, so every stage only pays for
+ * its own work.
+ *
+*/
+struct Fixture {
+    const Input &input; ///< The image
+    const BenchConfig &config; ///< The options
+    ThreadPool &pool; ///< The threads to split the stages across
+    Settings settings; ///< The default settings, for the ramp and character aspect
+    GlyphRamps ramps; ///< The glyph tables
+    LumImage gray; ///< The luminance of the image
+    RgbImage color; ///< The colors of the image
+    std::string text; ///< The image mapped to text at one character a pixel
+
+    /// A function to decode the luminance, false if it couldn't be
+    bool need_gray() {
+        return !gray.empty() || (decode_image(input.gray, gray, pool, [](double) { return true; }) == DecodeStatus::done && !gray.empty());
+    }
+
+    /// A function to decode the colors, false if they couldn't be
+    bool need_color() {
+        return !color.empty() || (decode_color(input.color, color, pool, [](double) { return true; }) == DecodeStatus::done && !color.empty());
+    }
+
+    /// A function to map the luminance to text, false if it couldn't be decoded
+    bool need_text() {
+        return !text.empty() || (need_gray() && map_glyphs(gray, ramps.get(settings.ramp, settings.dark_mode), text, pool));
+    }
+
+    /// A function that returns the height of the text the scaling stages make for an image
+    int rows(int width, int height) const {
+        return std::max(1, (int)(height * (double)config.columns / width / settings.char_aspect));
+    }
+};
+
+/// A function that runs a stage once and sets the bytes it reads, false if it failed
+using StageFunc = bool (*)(Fixture &f, double &bytes);
+/// A function that loads what a stage reads before it's timed, false if it couldn't
+using PrepareFunc = bool (*)(Fixture &f);
+
+/// The files a stage reads
+enum class Needs {
+    any, ///< Any image
+    pgm, ///< A binary .pgm file, which only synthetic images have
+    plain, ///< A plain .pgm file, which only synthetic images up to plain_max_mp have
+    colors, ///< Colored text at a character a pixel, which only runs up to colorize_max_mp
+};
+
+/// A stage of a conversion
+struct BenchStage {
+    const char *name; ///< What the results call it
+    Needs needs; ///< The files it reads
+    PrepareFunc prepare; ///< Loads what it reads, or nullptr if it reads files
+    StageFunc run; ///< Runs it
+};
+
+/// Loads the luminance of the image
+static bool prepare_gray(Fixture &f) {
+    return f.need_gray();
+}
+
+/// Loads the text of the image
+static bool prepare_text(Fixture &f) {
+    return f.need_text();
+}
+
+/// Loads the text and the colors of the image
+static bool prepare_colors(Fixture &f) {
+    return f.need_text() && f.need_color();
+}
+
+/**
+ * Returns the size of a file, or 0 if it can't be read.
+ *
+ * @param[in] path the file
+ * @return its size in bytes
+ *
+*/
+static double file_bytes(const std::string &path) {
+    std::error_code error;
+    std::uintmax_t size = std::filesystem::file_size(path, error);
+    return error ? 0.0 : (double)size;
+}
+
+/**
+ * Scales the luminance to the text size with a filter.
+ *
+ * @param[in,out] f the fixture
+ * @param[in] filter the filter
+ * @param[out] bytes the bytes of luminance read
+ * @return false if the image couldn't be decoded
+ *
+*/
+static bool resample_with(Fixture &f, Filter filter, double &bytes) {
+    if (!f.need_gray()) {
+        return false;
+    }
+    const int width = f.gray.width(), height = f.gray.height();
+    LumImage scaled;
+    bytes = (double)width * height;
+    return Resampler(width, height, f.config.columns, f.rows(width, height), filter).resample(f.gray.view(), scaled, f.pool);
+}
+
+/**
+ * Colors the text in a mode.
+ *
+ * @param[in,out] f the fixture
+ * @param[in] mode how to color it
+ * @param[out] bytes the bytes of text read
+ * @return false if the image couldn't be decoded
+ *
+*/
+static bool colorize_with(Fixture &f, ColorMode mode, double &bytes) {
+    if (!f.need_text() || !f.need_color()) {
+        return false;
+    }
+    bytes = (double)f.text.size();
+    return colorize(f.text, f.color, mode, f.settings.dark_mode).size() > f.text.size();
+}
+
+/**
+ * Exports the text in a format to /dev/null, through the same
+ * pieces and writes as saving a file.
+ *
+ * @param[in,out] f the fixture
+ * @param[in] format the format
+ * @param[out] bytes the bytes of text read
+ * @return false if the image couldn't be decoded
+ *
+*/
+static bool export_with(Fixture &f, ExportFormat format, double &bytes) {
+    if (!f.need_text()) {
+        return false;
+    }
+    bytes = (double)f.text.size();
+    return export_art(f.text, *make_exporter(format), "/dev/null", nullptr, [](double) { return true; });
+}
+
+/**
+ * Streams a file with convert_stream(), the way the low memory
+ * setting converts it, and stops at the first check of progress,
+ * so the time is the longest a cancel can wait at the start of a
+ * streamed conversion. With cancel_columns, every output row
+ * needs many source rows, which is when the rows read between
+ * checks matter the most.
+ *
+ * @param[in,out] f the fixture
+ * @param[in] path the file, a binary .pgm file is mapped and anything else goes through ImageMagick
+ * @param[out] bytes the bytes of luminance read before the stream stopped
+ * @return false if the file couldn't be streamed or progress was never checked
+ *
+*/
+static bool stream_cancel_with(Fixture &f, const std::string &path, double &bytes) {
+    std::unique_ptr<RowSource> source = open_row_source(path);
+    if (!source) {
+        return false;
+    }
+    const int width = source->width(), height = source->height();
+    const int rows = std::max(1, (int)(height * (double)cancel_columns / width / f.settings.char_aspect));
+    std::string text;
+    double stopped_at = -1.0;
+    convert_stream(*source, cancel_columns, rows, f.settings.filter, f.ramps.get(f.settings.ramp, f.settings.dark_mode), text,
+                   [&stopped_at](double frac) {
+        stopped_at = frac;
+        return false;
+    });
+    bytes = std::max(0.0, stopped_at) * width * height;
+    return stopped_at >= 0.0;
+}
+
+/// Every stage, in the order a conversion runs them
+static const BenchStage stages[] = {
+    {"parse_header", Needs::pgm, nullptr, [](Fixture &f, double &bytes) { // finding the pixels in a .pgm file
+        MappedFile file(f.input.gray);
+        PgmHeader header;
+        bytes = (double)file.size();
+        return file.is_open() && parse_pgm_header(file.data(), file.size(), header);
+    }},
+    {"read_p5", Needs::pgm, nullptr, [](Fixture &f, double &bytes) { // reading the pixels of a binary .pgm file
+        MappedFile file(f.input.gray);
+        PgmHeader header;
+        if (!file.is_open() || !parse_pgm_header(file.data(), file.size(), header) || !header.complete(file.size())) {
+            return false;
+        }
+        bytes = (double)header.pixel_bytes();
+        return read_p5(file.data(), header, f.gray, f.pool, [](double) { return true; });
+    }},
+    {"parse_p2", Needs::plain, nullptr, [](Fixture &f, double &bytes) { // parsing the pixels of a plain .pgm file
+        MappedFile file(f.input.plain);
+        PgmHeader header;
+        if (!file.is_open() || !parse_pgm_header(file.data(), file.size(), header)) {
+            return false;
+        }
+        bytes = (double)file.size();
+        LumImage image;
+        return parse_p2(file.data(), file.size(), header, image, f.pool, [](double) { return true; });
+    }},
+    {"stream_p5", Needs::pgm, nullptr, [](Fixture &f, double &bytes) { // converting a binary .pgm file a row at a time
+        std::unique_ptr<RowSource> source = open_row_source(f.input.gray);
+        if (!source) {
+            return false;
+        }
+        const int width = source->width(), height = source->height();
+        std::string text;
+        bytes = (double)width * height;
+        return convert_stream(*source, f.config.columns, f.rows(width, height), f.settings.filter,
+                              f.ramps.get(f.settings.ramp, f.settings.dark_mode), text, [](double) { return true; });
+    }},
+    {"stream_cancel_p5", Needs::pgm, nullptr, [](Fixture &f, double &bytes) { return stream_cancel_with(f, f.input.gray, bytes); }},
+    {"stream_cancel_p2", Needs::plain, nullptr, [](Fixture &f, double &bytes) { return stream_cancel_with(f, f.input.plain, bytes); }},
+    {"decode", Needs::any, nullptr, [](Fixture &f, double &bytes) {
+        LumImage image;
+        bytes = file_bytes(f.input.gray);
+        return decode_image(f.input.gray, image, f.pool, [](double) { return true; }) == DecodeStatus::done && !image.empty();
+    }},
+    {"decode_color", Needs::any, nullptr, [](Fixture &f, double &bytes) {
+        RgbImage image;
+        bytes = file_bytes(f.input.color);
+        return decode_color(f.input.color, image, f.pool, [](double) { return true; }) == DecodeStatus::done && !image.empty();
+    }},
+    {"resample_box", Needs::any, prepare_gray, [](Fixture &f, double &bytes) { return resample_with(f, Filter::box, bytes); }},
+    {"resample_bilinear", Needs::any, prepare_gray, [](Fixture &f, double &bytes) { return resample_with(f, Filter::bilinear, bytes); }},
+    {"resample_lanczos", Needs::any, prepare_gray, [](Fixture &f, double &bytes) { return resample_with(f, Filter::lanczos, bytes); }},
+    {"sat_box", Needs::any, prepare_gray, [](Fixture &f, double &bytes) { // building a summed-area table and scaling with it
+        if (!f.need_gray()) {
+            return false;
+        }
+        const int width = f.gray.width(), height = f.gray.height();
+        SummedAreaTable sat;
+        LumImage scaled;
+        bytes = (double)width * height;
+        return sat.build(f.gray.view(), f.pool) && sat.box_resample(f.config.columns, f.rows(width, height), scaled, f.pool);
+    }},
+    {"map_glyphs", Needs::any, prepare_gray, [](Fixture &f, double &bytes) { // at a character a pixel, so the kernel isn't lost in the noise
+        if (!f.need_gray()) {
+            return false;
+        }
+        std::string text;
+        bytes = (double)f.gray.width() * f.gray.height();
+        return map_glyphs(f.gray, f.ramps.get(f.settings.ramp, f.settings.dark_mode), text, f.pool);
+    }},
+    {"map_shapes", Needs::any, prepare_gray, [](Fixture &f, double &bytes) {
+        if (!f.need_gray()) {
+            return false;
+        }
+        const ShapeTable &shapes = f.ramps.shapes(f.settings.ramp, f.settings.dark_mode);
+        std::string text;
+        bytes = (double)f.gray.width() * f.gray.height();
+        return map_shapes(f.gray, shapes, text, f.pool);
+    }},
+    {"colorize_ansi256", Needs::colors, prepare_colors, [](Fixture &f, double &bytes) { return colorize_with(f, ColorMode::ansi256, bytes); }},
+    {"colorize_html", Needs::colors, prepare_colors, [](Fixture &f, double &bytes) { return colorize_with(f, ColorMode::html, bytes); }},
+    {"export_rtf", Needs::any, prepare_text, [](Fixture &f, double &bytes) { return export_with(f, ExportFormat::rtf, bytes); }},
+    {"export_html", Needs::any, prepare_text, [](Fixture &f, double &bytes) { return export_with(f, ExportFormat::html, bytes); }},
+    {"end_to_end", Needs::any, nullptr, [](Fixture &f, double &bytes) { // what the window does: decode, scale, map and save
+        LumImage image, scaled;
+        std::string text;
+        bytes = file_bytes(f.input.gray);
+        if (decode_image(f.input.gray, image, f.pool, [](double) { return true; }) != DecodeStatus::done || image.empty()) {
+            return false;
+        }
+        const int width = image.width(), height = image.height();
+        Resampler resampler(width, height, f.config.columns, f.rows(width, height), f.settings.filter);
+        return resampler.resample(image.view(), scaled, f.pool) &&
+               map_glyphs(scaled, f.ramps.get(f.settings.ramp, f.settings.dark_mode), text, f.pool) &&
+               export_art(text, *make_exporter(ExportFormat::rtf), "/dev/null", nullptr, [](double) { return true; });
+    }},
+};
+
+/**
+ * @brief Runs a stage and measures it
+ *
+ * Runs the stage config.repeat times and keeps the fastest run,
+ * which is the one least disturbed by everything else the machine
+ * was doing. Whatever the stage needs is loaded before the first
+ * run, so it isn't timed.
+ *
+ * @param[in] stage the stage
+ * @param[in] input the image
+ * @param[in] config the options
+ * @return how it ran
+ *
+*/
+static Measurement measure(const BenchStage &stage, const Input &input, const BenchConfig &config) {
+    using Clock = std::chrono::steady_clock;
+
+    ThreadPool pool(config.threads);
+    Fixture f{input, config, pool};
+    Measurement result;
+
+    if (stage.prepare && !stage.prepare(f)) { // so the first run is timed like the rest
+        return result;
+    }
+
+    result.seconds = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < config.repeat; i++) {
+        double bytes = 0.0;
+        const Clock::time_point start = Clock::now();
+        bool ok = stage.run(f, bytes);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (!ok) {
+            result.ok = false;
+            return result;
+        }
+        result.ok = true;
+        result.bytes = bytes;
+        result.seconds = std::min(result.seconds, seconds);
+    }
+
+    if (f.gray.empty() && !image_size(input.gray, result.width, result.height)) { // the stage didn't load the image
+        f.need_gray();
+    }
+    if (!f.gray.empty()) {
+        result.width = f.gray.width();
+        result.height = f.gray.height();
+    }
+    return result;
+}
+
+/**
+ * @brief Runs a stage in a process of its own
+ *
+ * Forks, measures the stage in the child and sends the result
+ * back through a pipe. The peak memory of the child is the peak
+ * memory of the stage and what it read, without anything left
+ * behind by the stages before it. The parent never starts a
+ * thread, so forking it is safe.
+ *
+ * @param[in] stage the stage
+ * @param[in] input the image
+ * @param[in] config the options
+ * @param[out] result how it ran
+ * @param[out] peak_rss the peak resident memory of the process, in kilobytes
+ * @return false if the process couldn't be started or died
+ *
+*/
+static bool run_isolated(const BenchStage &stage, const Input &input, const BenchConfig &config, Measurement &result, long &peak_rss) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Measurement measured = measure(stage, input, config);
+        ssize_t written = write(fds[1], &measured, sizeof(measured));
+        _exit(written == (ssize_t)sizeof(measured) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    std::size_t got = 0;
+    while (got < sizeof(result)) {
+        ssize_t count = read(fds[0], (char *)&result + got, sizeof(result) - got);
+        if (count <= 0) {
+            break;
+        }
+        got += count;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    rusage usage{};
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || got != sizeof(result)) {
+        return false;
+    }
+    peak_rss = usage.ru_maxrss; // kilobytes on Linux
+    return true;
+}
+
+/**
+ * @brief Writes the files of a synthetic image
+ *
+ * Writes a binary .pgm, a binary .ppm and, up to plain_max_mp, a
+ * plain .pgm file with the same pixels: gradients with some noise,
+ * so the colors change now and then along a row, like a photo,
+ * without the values being random. Rows are written one at a time,
+ * so the process that forks the stages stays small.
+ *
+ * @param[in] dir the directory to write them in
+ * @param[in] megapixels the size of the image
+ * @param[out] input the image, named after its size
+ * @return false if a file couldn't be written
+ *
+*/
+static bool make_synthetic(const std::filesystem::path &dir, double megapixels, Input &input) {
+    const int width = (int)std::lround(std::sqrt(megapixels * 1e6 * 4 / 3)); // 4:3, like most photos
+    const int height = (int)std::lround(width * 3.0 / 4);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "synthetic-%gMP", megapixels);
+    input.name = name;
+    input.megapixels = megapixels;
+    input.gray = (dir / (input.name + ".pgm")).string();
+    input.color = (dir / (input.name + ".ppm")).string();
+    input.plain = megapixels <= plain_max_mp ? (dir / (input.name + "-plain.pgm")).string() : std::string();
+
+    std::ofstream gray(input.gray, std::ios::binary), color(input.color, std::ios::binary), plain;
+    gray << "P5\n" << width << " " << height << "\n255\n";
+    color << "P6\n" << width << " " << height << "\n255\n";
+    if (!input.plain.empty()) {
+        plain.open(input.plain, std::ios::binary);
+        plain << "P2\n" << width << " " << height << "\n255\n";
+    }
+
+    std::vector<unsigned char> lum(width), rgb((std::size_t)width * 3);
+    std::string line;
+    unsigned int noise = 2463534242u; // xorshift, so every run makes the same image
+    for (int y = 0; y < height; y++) {
+        line.clear();
+        for (int x = 0; x < width; x++) {
+            noise ^= noise << 13;
+            noise ^= noise >> 17;
+            noise ^= noise << 5;
+            const int jitter = (int)(noise & 15) - 8;
+            const int red = std::clamp(x * 255 / width + jitter, 0, 255);
+            const int green = std::clamp(y * 255 / height + jitter, 0, 255);
+            const int blue = std::clamp(255 - (x + y) * 255 / (width + height) + jitter, 0, 255);
+            rgb[(std::size_t)x * 3] = red;
+            rgb[(std::size_t)x * 3 + 1] = green;
+            rgb[(std::size_t)x * 3 + 2] = blue;
+            lum[x] = (red * 77 + green * 150 + blue * 29) >> 8;
+            if (plain.is_open()) {
+                line += std::to_string(lum[x]);
+                line += x + 1 < width ? ' ' : '\n';
+            }
+        }
+        gray.write((const char *)lum.data(), width);
+        color.write((const char *)rgb.data(), rgb.size());
+        if (plain.is_open()) {
+            plain << line;
+        }
+    }
+
+    gray.close();
+    color.close();
+    plain.close();
+    return gray && color && (input.plain.empty() || plain);
+}
+
+/**
+ * Removes the files of a synthetic image.
+ *
+ * @param[in] input the image
+ *
+*/
+static void remove_synthetic(const Input &input) {
+    std::error_code error;
+    for (const std::string &path : {input.gray, input.color, input.plain}) {
+        if (!path.empty()) {
+            std::filesystem::remove(path, error);
+        }
+    }
+}
+
+/**
+ * Writes a string as a JSON string, escaping what JSON needs
+ * escaped.
+ *
+ * @param[in,out] out the stream to write to
+ * @param[in] text the string
+ *
+*/
+static void write_json_string(std::ostream &out, const std::string &text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+/**
+ * Reads the options. Anything that doesn't start with '-' is an
+ * image to run on.
+ *
+ * @param[in] argc the number of arguments
+ * @param[in] argv the arguments
+ * @param[out] config the options
+ * @param[out] help whether to show the usage and stop
+ * @return false if the arguments were wrong
+ *
+*/
+static bool parse_args(int argc, char *argv[], BenchConfig &config, bool &help) {
+    help = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto number = [&](double &value) {
+            if (i + 1 >= argc) {
+                return false;
+            }
+            char *end;
+            value = std::strtod(argv[++i], &end);
+            return *end == '\0' && value > 0;
+        };
+
+        double value;
+        if (arg == "-h" || arg == "--help") {
+            help = true;
+        } else if (arg == "-j" || arg == "--threads") {
+            if (!number(value)) return false;
+            config.threads = (int)value;
+        } else if (arg == "-r" || arg == "--repeat") {
+            if (!number(value)) return false;
+            config.repeat = (int)value;
+        } else if (arg == "-m" || arg == "--max-mp") {
+            if (!number(value)) return false;
+            config.max_mp = value;
+        } else if (arg == "-c" || arg == "--columns") {
+            if (!number(value)) return false;
+            config.columns = (int)value;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return false;
+        } else {
+            config.files.push_back(arg);
+        }
+    }
+    return config.threads > 0 && config.repeat > 0 && config.columns > 0;
+}
+
+int main(int argc, char *argv[]) {
+    BenchConfig config;
+    bool help;
+    if (!parse_args(argc, argv, config, help)) {
+        std::cerr << usage;
+        return 2;
+    }
+    if (help) {
+        std::cout << usage;
+        return 0;
+    }
+
+    if (config.files.empty()) { // the images that come with the repository
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator("images", error)) {
+            if (entry.is_regular_file()) {
+                config.files.push_back(entry.path().string());
+            }
+        }
+        std::sort(config.files.begin(), config.files.end());
+    }
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / ("ascii-bench-" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+
+    std::vector<Input> inputs;
+    for (double megapixels : synthetic_sizes) {
+        if (megapixels <= config.max_mp) {
+            inputs.push_back(Input{std::string(), megapixels}); // its files are made when its turn comes, so only one is on disk at a time
+        }
+    }
+    for (const std::string &file : config.files) {
+        inputs.push_back(Input{file, 0.0, file, file, std::string()});
+    }
+
+    std::cout << "{\n  \"version\": ";
+    write_json_string(std::cout, BENCH_VERSION);
+    std::cout << ",\n  \"threads\": " << config.threads << ",\n  \"repeat\": " << config.repeat
+              << ",\n  \"columns\": " << config.columns << ",\n  \"results\": [";
+    bool first = true;
+    int failures = 0;
+
+    for (Input &input : inputs) {
+        if (input.megapixels > 0) {
+            std::cerr << "writing " << input.megapixels << " MP synthetic image" << std::endl;
+            if (!make_synthetic(dir, input.megapixels, input)) {
+                std::cerr << "bench: could not write the synthetic image to " << dir << std::endl;
+                remove_synthetic(input);
+                failures++;
+                continue;
+            }
+        }
+
+        for (const BenchStage &stage : stages) {
+            if ((stage.needs == Needs::pgm && input.megapixels == 0) || (stage.needs == Needs::plain && input.plain.empty()) ||
+                (stage.needs == Needs::colors && input.megapixels > colorize_max_mp)) {
+                continue;
+            }
+            std::cerr << input.name << ": " << stage.name << std::endl;
+
+            Measurement result;
+            long peak_rss = 0;
+            bool ran = run_isolated(stage, input, config, result, peak_rss);
+
+            std::cout << (first ? "\n" : ",\n") << "    {\"input\": ";
+            first = false;
+            write_json_string(std::cout, input.name);
+            std::cout << ", \"stage\": \"" << stage.name << "\"";
+            if (!ran || !result.ok) {
+                std::cout << ", \"error\": \"" << (ran ? "the stage failed" : "the process died") << "\"}";
+                failures++;
+                if (std::string(stage.name) == "decode") { // every stage after it needs the image
+                    break;
+                }
+                continue;
+            }
+
+            const double pixels = (double)result.width * result.height;
+            std::cout << ", \"width\": " << result.width << ", \"height\": " << result.height
+                      << ", \"seconds\": " << result.seconds << ", \"bytes\": " << (long long)result.bytes
+                      << ", \"ns_per_pixel\": " << (pixels > 0 ? result.seconds * 1e9 / pixels : 0.0)
+                      << ", \"mb_per_s\": " << (result.seconds > 0 ? result.bytes / result.seconds / 1e6 : 0.0)
+                      << ", \"peak_rss_kb\": " << peak_rss << "}";
+        }
+        std::cout.flush();
+
+        if (input.megapixels > 0) {
+            remove_synthetic(input);
+        }
+    }
+
+    std::cout << "\n  ]\n}" << std::endl;
+    std::error_code error;
+    std::filesystem::remove_all(dir, error);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,286 @@
+#include "cache.hpp"
+#include "pgm.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @file cache.cc
+ *
+*/
+
+/// The header at the start of every cache entry
+struct CacheEntryHeader {
+    char magic[4]; ///< Always "ALUM"
+    std::uint32_t version; ///< The version of the entry format
+    unsigned long long id[4]; ///< The device, inode, modification time and size of the image
+    std::uint32_t width; ///< The width of the image
+    std::uint32_t height; ///< The height of the image
+};
+
+/// The version of the cache entry format, changed whenever the format changes
+constexpr std::uint32_t cache_version = 1;
+
+/**
+ * Finds the cache directory, which is $XDG_CACHE_HOME/ascii or
+ * ~/.cache/ascii. If neither variable is set, nothing is cached.
+ *
+*/
+LumCache::LumCache() {
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        directory = std::string(xdg) + "/ascii";
+    } else if (const char *home = std::getenv("HOME"); home && *home) {
+        directory = std::string(home) + "/.cache/ascii";
+    }
+}
+
+/**
+ * Reads the device, inode, modification time and size of a file.
+ *
+ * @param[in] filename the path of the file
+ * @return false if the file can't be found
+ *
+*/
+bool FileId::read(const std::string &filename) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) {
+        return false;
+    }
+
+    std::error_code err;
+    auto mtime = std::filesystem::last_write_time(filename, err);
+    if (err) {
+        return false;
+    }
+
+    id[0] = info.st_dev;
+    id[1] = info.st_ino;
+    id[2] = mtime.time_since_epoch().count();
+    id[3] = info.st_size;
+
+    return true;
+}
+
+/**
+ * @brief Gets the path of the cache entry for an image
+ *
+ * Identifies the image with a FileId and hashes it into the
+ * entry's file name.
+ *
+ * @param[in] filename the path of the image
+ * @param[out] path the path of the cache entry
+ * @param[out] id the identity of the image
+ * @return false if the image can't be found or there is no cache directory
+ *
+*/
+bool LumCache::entry_path(const std::string &filename, std::string &path, FileId &id) const {
+    if (directory.empty() || !id.read(filename)) {
+        return false;
+    }
+
+    std::uint64_t hash = 14695981039346656037ull; // 64 bit FNV-1a
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 8; b++) {
+            hash ^= (id.id[i] >> (b * 8)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.lum", (unsigned long long)hash);
+    path = directory + "/" + name;
+
+    return true;
+}
+
+/**
+ * Loads the luminance values of an image from its cache entry if
+ * there is one, and marks the entry as recently used.
+ *
+ * @param[in] filename the path of the image
+ * @param[out] image the image to store the luminance values in
+ * @param[in] cancel checked every 64 rows, since reading an entry can wait on the disk
+ * @return whether the image was in the cache
+ *
+*/
+bool LumCache::load(const std::string &filename, LumImage &image, const CancelToken *cancel) {
+    std::string path;
+    FileId id;
+    if (!entry_path(filename, path, id)) {
+        return false;
+    }
+
+    MappedFile entry(path);
+    if (!entry.is_open() || entry.size() < sizeof(CacheEntryHeader)) {
+        return false;
+    }
+
+    CacheEntryHeader header;
+    std::memcpy(&header, entry.data(), sizeof(header));
+    if (std::memcmp(header.magic, "ALUM", 4) != 0 || header.version != cache_version ||
+        std::memcmp(header.id, id.id, sizeof(header.id)) != 0 || // a different image with the same hash
+        entry.size() - sizeof(header) != (std::size_t)header.width * header.height) {
+        return false;
+    }
+
+    const unsigned char *pixels = entry.data() + sizeof(header);
+    image.resize(header.width, header.height);
+    for (std::uint32_t y = 0; y < header.height; y++) {
+        if (y % 64 == 0 && cancelled(cancel)) {
+            return false;
+        }
+        std::memcpy(image.row(y), pixels, header.width);
+        pixels += header.width;
+    }
+
+    std::error_code err;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), err); // most recently used
+
+    return true;
+}
+
+/**
+ * Writes the luminance values of an image to a new cache entry
+ * and deletes old entries until the cache fits in the budget. The
+ * entry is written to a temporary file first so that other instances
+ * never see half of one. A large image can take a while to write,
+ * so cancel is checked every 64 rows and the temporary file is
+ * removed if it's set.
+ *
+ * @param[in] filename the path of the image
+ * @param[in] image the luminance values of the image
+ * @param[in] budget the most bytes the cache can use, 0 to not cache anything
+ * @param[in] cancel checked every 64 rows
+ *
+*/
+void LumCache::store(const std::string &filename, const LumImage &image, std::size_t budget, const CancelToken *cancel) {
+    std::string path;
+    FileId id;
+    if (budget == 0 || image.empty() || !entry_path(filename, path, id)) {
+        return;
+    }
+
+    CacheEntryHeader header;
+    std::memcpy(header.magic, "ALUM", 4);
+    header.version = cache_version;
+    std::memcpy(header.id, id.id, sizeof(header.id));
+    header.width = image.width();
+    header.height = image.height();
+
+    if (sizeof(header) + (std::size_t)header.width * header.height > budget) { // it would push everything else out
+        return;
+    }
+
+    std::error_code err;
+    std::filesystem::create_directories(directory, err);
+
+    std::string temp = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write((const char *)&header, sizeof(header));
+        for (int y = 0; y < image.height() && out; y++) {
+            if (y % 64 == 0 && cancelled(cancel)) {
+                out.setstate(std::ios::failbit); // removed below, the same as a failed write
+                break;
+            }
+            out.write((const char *)image.row(y), image.width());
+        }
+
+        if (!out) {
+            out.close();
+            std::filesystem::remove(temp, err);
+            return;
+        }
+    }
+    std::filesystem::rename(temp, path, err);
+
+    evict(budget);
+}
+
+/**
+ * @brief Checks whether a temporary entry was left behind
+ *
+ * Temporary entries are named <entry>.<pid>.tmp by the process
+ * writing them. One whose process no longer exists was left behind
+ * by a crash or a kill, and nothing will ever rename it.
+ *
+ * @param[in] path the file in the cache directory
+ * @return whether it's a temporary entry that's been left behind
+ *
+*/
+static bool stale_temp(const std::filesystem::path &path) {
+    if (path.extension() != ".tmp") {
+        return false;
+    }
+    const std::string pid_text = path.stem().extension().string(); // ".<pid>"
+    char *end;
+    const long pid = pid_text.size() > 1 ? std::strtol(pid_text.c_str() + 1, &end, 10) : 0;
+    if (pid <= 0 || *end != '\0' || pid == getpid()) {
+        return false;
+    }
+    return kill((pid_t)pid, 0) != 0 && errno == ESRCH;
+}
+
+/**
+ * @brief Trims the cache to fit in a budget
+ *
+ * Deletes cache entries, least recently used first, until all of
+ * them together use at most budget bytes. Temporary entries left
+ * behind by processes that are gone are deleted first, since they
+ * would otherwise take up space the budget doesn't know about.
+ *
+ * @param[in] budget the most bytes the cache can use
+ *
+*/
+void LumCache::evict(std::size_t budget) {
+    struct Entry {
+        std::filesystem::file_time_type used;
+        std::uintmax_t size;
+        std::filesystem::path path;
+    };
+    std::vector<Entry> entries;
+    std::uintmax_t total = 0;
+
+    std::error_code err;
+    for (const auto &file : std::filesystem::directory_iterator(directory, err)) {
+        if (stale_temp(file.path())) {
+            std::error_code file_err;
+            std::filesystem::remove(file.path(), file_err);
+            continue;
+        }
+        if (file.path().extension() != ".lum") {
+            continue;
+        }
+        std::error_code file_err;
+        Entry entry{file.last_write_time(file_err), file.file_size(file_err), file.path()};
+        if (!file_err) {
+            total += entry.size;
+            entries.push_back(entry);
+        }
+    }
+
+    if (total <= budget) {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.used < b.used;
+    });
+    for (const Entry &entry : entries) {
+        if (total <= budget) {
+            break;
+        }
+        if (std::filesystem::remove(entry.path, err)) {
+            total -= entry.size;
+        }
+    }
+}
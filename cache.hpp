@@ -0,0 +1,55 @@
+#include <cstddef>
+#include <string>
+#include "image.hpp"
+#include "cancel.hpp"
+
+#pragma once
+
+/**
+ * @file cache.hpp
+ *
+*/
+
+/**
+ * @brief What identifies one version of a file
+ *
+ * A structure that holds the device, inode, modification time
+ * and size of a file. If any of them change, the file has been
+ * replaced or edited.
+ *
+*/
+struct FileId {
+    unsigned long long id[4] = {0, 0, 0, 0}; ///< The device, inode, modification time and size
+
+    bool read(const std::string &filename); ///< A function to read the identity of a file, false if it can't be found
+    bool operator==(const FileId &other) const = default; ///< A function to compare two identities
+};
+
+/**
+ * @brief A class to keep decoded images on disk
+ *
+ * A cache of decoded 8-bit luminance values, stored as one small
+ * binary file per image in the user's cache directory. Files are
+ * found by the device, inode, modification time and size of the
+ * image, so editing an image makes its old entry useless instead of
+ * wrong. When the cache grows past its budget, the least recently
+ * used entries are deleted.
+ *
+*/
+class LumCache {
+    public:
+        LumCache(); ///< The LumCache constructor, finds the cache directory
+
+        /// A function to load the cached luminance values of an image, false if there are none or it was cancelled
+        bool load(const std::string &filename, LumImage &image, const CancelToken *cancel = nullptr);
+
+        /// A function to save the luminance values of an image and trim the cache to budget bytes, nothing is saved if it's cancelled
+        void store(const std::string &filename, const LumImage &image, std::size_t budget, const CancelToken *cancel = nullptr);
+
+    private:
+        /// A function to get the path of the cache entry for an image
+        bool entry_path(const std::string &filename, std::string &path, FileId &id) const;
+        void evict(std::size_t budget); ///< A function to delete the least recently used entries until the cache fits in budget bytes
+
+        std::string directory; ///< The directory the cache entries are kept in, empty if there isn't one
+};
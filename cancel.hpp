@@ -0,0 +1,32 @@
+#include <atomic>
+
+#pragma once
+
+/**
+ * @file cancel.hpp
+ *
+*/
+
+/**
+ * @brief A flag that tells a job to stop as soon as it can
+ *
+ * A class that one thread sets and any number of threads check.
+ * Checking is a single relaxed atomic load with no mutex, so it's
+ * cheap enough to do once per row in the tightest loops, which is
+ * what keeps the time from a cancel to the job stopping short.
+ *
+*/
+class CancelToken {
+    public:
+        void cancel() { flag.store(true, std::memory_order_relaxed); } ///< A function to ask the job to stop
+        void reset() { flag.store(false, std::memory_order_relaxed); } ///< A function to clear the flag for a new job
+        bool cancelled() const { return flag.load(std::memory_order_relaxed); } ///< A function that returns whether the job should stop
+
+    private:
+        std::atomic<bool> flag{false}; ///< Whether the job should stop
+};
+
+/// A function that returns whether cancel is set, for stages that can run without a token
+inline bool cancelled(const CancelToken *cancel) {
+    return cancel && cancel->cancelled();
+}
@@ -0,0 +1,189 @@
+#include "color.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+
+/**
+ * @file color.cc
+ *
+*/
+
+/// The number of bits of each channel the palette lookup table is indexed by
+constexpr int lut_bits = 5;
+
+/// The levels of each channel in the 6x6x6 color cube of the xterm palette, entries 16-231
+constexpr int cube_levels[6] = {0, 95, 135, 175, 215, 255};
+
+/**
+ * @brief Builds the lookup table from colors to the xterm palette
+ *
+ * Only the 6x6x6 color cube and the 24 grays are used, because
+ * terminals let users change the first 16 colors. The cube is a
+ * grid, so the closest cube color is the closest level of each
+ * channel on its own, and it's only compared with the closest gray.
+ * Each entry is for the middle of its range of colors.
+ *
+ * @return the palette entry for every color, indexed by the top lut_bits bits of red, green and blue
+ *
+*/
+static std::array<unsigned char, 1 << (3 * lut_bits)> make_palette_lut() {
+    std::array<unsigned char, 1 << (3 * lut_bits)> lut{};
+    constexpr int step = 1 << (8 - lut_bits);
+
+    for (int i = 0; i < (int)lut.size(); i++) {
+        int rgb[3] = {(i >> (2 * lut_bits)) * step + step / 2, ((i >> lut_bits) & ((1 << lut_bits) - 1)) * step + step / 2,
+                        (i & ((1 << lut_bits) - 1)) * step + step / 2};
+
+        int cube = 0;
+        int cube_distance = 0;
+        for (int c = 0; c < 3; c++) {
+            int best = 0;
+            for (int l = 1; l < 6; l++) {
+                if (std::abs(cube_levels[l] - rgb[c]) < std::abs(cube_levels[best] - rgb[c])) {
+                    best = l;
+                }
+            }
+            cube = cube * 6 + best;
+            cube_distance += (cube_levels[best] - rgb[c]) * (cube_levels[best] - rgb[c]);
+        }
+
+        int gray = std::min(std::max(((rgb[0] + rgb[1] + rgb[2]) / 3 - 8 + 5) / 10, 0), 23); // grays are 8, 18 ... 238
+        int gray_distance = 0;
+        for (int c = 0; c < 3; c++) {
+            gray_distance += (8 + 10 * gray - rgb[c]) * (8 + 10 * gray - rgb[c]);
+        }
+
+        lut[i] = gray_distance < cube_distance ? 232 + gray : 16 + cube;
+    }
+
+    return lut;
+}
+
+/**
+ * Looks the color up in a table built the first time it's
+ * needed, so coloring costs one lookup per cell.
+ *
+ * @param[in] red the red value
+ * @param[in] green the green value
+ * @param[in] blue the blue value
+ * @return the palette entry, from 16 to 255
+ *
+*/
+unsigned char xterm_color(unsigned char red, unsigned char green, unsigned char blue) {
+    static const std::array<unsigned char, 1 << (3 * lut_bits)> lut = make_palette_lut();
+    return lut[((red >> (8 - lut_bits)) << (2 * lut_bits)) | ((green >> (8 - lut_bits)) << lut_bits) |
+                (blue >> (8 - lut_bits))];
+}
+
+/**
+ * @brief Appends a number from 0 to 255 in decimal
+ *
+ * @param[in,out] out the string to append to
+ * @param[in] value the number
+ *
+*/
+static inline void append_byte(std::string &out, int value) {
+    if (value >= 100) {
+        out += (char)('0' + value / 100);
+    }
+    if (value >= 10) {
+        out += (char)('0' + value / 10 % 10);
+    }
+    out += (char)('0' + value % 10);
+}
+
+/**
+ * @brief Colors ASCII art
+ *
+ * Gives every character the color of the cell it was made from.
+ * A color is only written when it changes, so a run of cells with
+ * the same color shares one escape or span, and spaces never start
+ * a new run because they don't show any color. Without that, the
+ * escapes would make the text many times bigger. The 256 color
+ * palette is matched with xterm_color().
+ *
+ * @param[in] text the ASCII art, colors.width() characters and a newline for every row
+ * @param[in] colors the color of every character
+ * @param[in] mode the kind of escapes to write
+ * @param[in] dark_mode whether the HTML background should be dark
+ * @return the colored text, or text unchanged if mode is ColorMode::none or text doesn't fit colors
+ *
+*/
+std::string colorize(const std::string &text, const RgbImage &colors, ColorMode mode, bool dark_mode) {
+    const int width = colors.width();
+    const int height = colors.height();
+    if (mode == ColorMode::none || text.size() < (std::size_t)(width + 1) * height) {
+        return text;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(text.size() * 4);
+    if (mode == ColorMode::html) {
+        out += "<pre style=\"font-family:monospace;line-height:1;background:";
+        out += dark_mode ? "#000000" : "#ffffff";
+        out += "\">";
+    }
+
+    long current = -1; // the color of the run being written, -1 before the first one
+    std::size_t pos = 0;
+    for (int y = 0; y < height; y++) {
+        const unsigned char *red = colors.planes[0].row(y);
+        const unsigned char *green = colors.planes[1].row(y);
+        const unsigned char *blue = colors.planes[2].row(y);
+
+        for (int x = 0; x < width; x++, pos++) {
+            const char c = text[pos];
+            if (c != ' ') {
+                long color = mode == ColorMode::ansi256 ? xterm_color(red[x], green[x], blue[x])
+                                                        : (red[x] << 16) | (green[x] << 8) | blue[x];
+                if (color != current) {
+                    switch (mode) {
+                        case ColorMode::ansi24:
+                            out += "\x1b[38;2;";
+                            append_byte(out, red[x]);
+                            out += ';';
+                            append_byte(out, green[x]);
+                            out += ';';
+                            append_byte(out, blue[x]);
+                            out += 'm';
+                            break;
+                        case ColorMode::ansi256:
+                            out += "\x1b[38;5;";
+                            append_byte(out, color);
+                            out += 'm';
+                            break;
+                        case ColorMode::html:
+                            if (current >= 0) {
+                                out += "</span>";
+                            }
+                            out += "<span style=\"color:#";
+                            for (int shift = 20; shift >= 0; shift -= 4) {
+                                out += hex[(color >> shift) & 0xF];
+                            }
+                            out += "\">";
+                            break;
+                        case ColorMode::none:
+                            break;
+                    }
+                    current = color;
+                }
+            }
+
+            if (mode == ColorMode::html && (c == '<' || c == '>' || c == '&')) {
+                out += c == '<' ? "&lt;" : c == '>' ? "&gt;" : "&amp;";
+            } else {
+                out += c;
+            }
+        }
+        out += '\n';
+        pos++; // the newline of the row
+    }
+
+    if (mode == ColorMode::html) { // every row already ends with a newline, so another would add a blank line
+        out += current >= 0 ? "</span></pre>" : "</pre>";
+    } else {
+        out += "\x1b[0m";
+    }
+    return out;
+}
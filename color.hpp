@@ -0,0 +1,23 @@
+#include <string>
+#include "image.hpp"
+
+#pragma once
+
+/**
+ * @file color.hpp
+ *
+*/
+
+/// The ways ASCII art can be colored
+enum class ColorMode {
+    none, ///< Plain text
+    ansi24, ///< 24-bit ANSI escapes, for terminals with true color
+    ansi256, ///< ANSI escapes for the xterm 256 color palette
+    html ///< HTML spans inside a pre element
+};
+
+/// A function that returns the entry of the xterm 256 color palette closest to a color
+unsigned char xterm_color(unsigned char red, unsigned char green, unsigned char blue);
+
+/// A function to color ASCII art with the colors of the cells it was made from
+std::string colorize(const std::string &text, const RgbImage &colors, ColorMode mode, bool dark_mode);
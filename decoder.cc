@@ -0,0 +1,1018 @@
+#include "decoder.hpp"
+#include "stream.hpp"
+#include "threadpool.hpp"
+#include "frames.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <fcntl.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+/**
+ * @file decoder.cc
+ *
+*/
+
+/**
+ * Maps the file and, if it starts with a .pgm header, reads the
+ * pixels straight out of the mapping.
+ *
+ * @param[in] filename the path of the .pgm file
+ * @param[out] image the image to store the luminance values in
+ * @param[in] pool the threads to read the pixels on
+ * @param[in] progress a function to report progress to, which can stop the decoding
+ * @return whether the file was decoded, wasn't a .pgm file, or was stopped
+ *
+*/
+DecodeStatus PgmDecoder::decode(const std::string &filename, LumImage &image, ThreadPool &pool,
+                                const ProgressFunc &progress) {
+    MappedFile pgm(filename); // map the pgm file instead of reading it into a string
+    PgmHeader header;
+
+    if (!pgm.is_open() || !parse_pgm_header(pgm.data(), pgm.size(), header) ||
+        (header.binary && !header.complete(pgm.size()))) {
+        return DecodeStatus::failed;
+    }
+
+    bool finished;
+    if (header.binary) {
+        finished = read_p5(pgm.data(), header, image, pool, progress);
+    } else {
+        finished = parse_p2(pgm.data(), pgm.size(), header, image, pool, progress);
+    }
+
+    return finished ? DecodeStatus::done : DecodeStatus::stopped;
+}
+
+/**
+ * @brief Converts rows of a GdkPixbuf to luminance values
+ *
+ * Uses the Rec. 709 luma weights and ignores any alpha channel.
+ *
+ * @param[in] pixbuf the pixbuf to convert
+ * @param[in] begin the first row to convert
+ * @param[in] end the row after the last row to convert
+ * @param[out] image an image the size of pixbuf to store the luminance values in
+ *
+*/
+static void pixbuf_rows(const GdkPixbuf *pixbuf, int begin, int end, LumImage &image) {
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int channels = gdk_pixbuf_get_n_channels(pixbuf);
+    const guchar *pixels = gdk_pixbuf_read_pixels(pixbuf);
+
+    for (int y = begin; y < end; y++) {
+        const guchar *src = pixels + (std::size_t)y * rowstride;
+        unsigned char *dst = image.row(y);
+        for (int x = 0; x < width; x++) {
+            const guchar *px = src + x * channels;
+            dst[x] = (54 * px[0] + 183 * px[1] + 19 * px[2] + 128) >> 8; // 0.2126 R + 0.7152 G + 0.0722 B
+        }
+    }
+}
+
+/**
+ * @brief Feeds a file to a GdkPixbufLoader a piece at a time
+ *
+ * Maps the file and feeds it to the loader in small pieces,
+ * checking in with progress between them, so a decode can be
+ * stopped without waiting for the whole file. Most loaders decode
+ * as the pieces arrive. The loader is always closed.
+ *
+ * @param[in] filename the path of the image
+ * @param[in,out] loader the loader to feed, which still has to be unreferenced
+ * @param[in] progress a function that's given the fraction of the file loaded and can stop the loading
+ * @return whether the image was loaded, couldn't be loaded, or was stopped
+ *
+*/
+static DecodeStatus feed_loader(const std::string &filename, GdkPixbufLoader *loader, const ProgressFunc &progress) {
+    MappedFile file(filename);
+    if (!file.is_open() || file.size() == 0) {
+        gdk_pixbuf_loader_close(loader, nullptr);
+        return DecodeStatus::failed;
+    }
+
+    constexpr std::size_t piece = 1 << 18;
+    GError *error = nullptr;
+    DecodeStatus status = DecodeStatus::done;
+
+    for (std::size_t pos = 0; pos < file.size(); pos += piece) {
+        if (!progress((double)pos / file.size())) {
+            status = DecodeStatus::stopped;
+            break;
+        }
+        if (!gdk_pixbuf_loader_write(loader, file.data() + pos, std::min(piece, file.size() - pos), &error)) {
+            status = DecodeStatus::failed;
+            break;
+        }
+    }
+
+    bool closed = gdk_pixbuf_loader_close(loader, status == DecodeStatus::done ? &error : nullptr);
+    g_clear_error(&error);
+    if (status == DecodeStatus::done && !closed) {
+        status = DecodeStatus::failed;
+    }
+    return status;
+}
+
+/**
+ * @brief Loads an image with GdkPixbuf a piece at a time
+ *
+ * @param[in] filename the path of the image
+ * @param[out] pixbuf the loaded image, which must be unreferenced
+ * @param[in] progress a function that's given the fraction of the file loaded and can stop the loading
+ * @return whether the image was loaded, couldn't be loaded, or was stopped
+ *
+*/
+static DecodeStatus load_pixbuf(const std::string &filename, GdkPixbuf *&pixbuf, const ProgressFunc &progress) {
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    DecodeStatus status = feed_loader(filename, loader, progress);
+    pixbuf = status == DecodeStatus::done ? gdk_pixbuf_loader_get_pixbuf(loader) : nullptr;
+    if (pixbuf) {
+        g_object_ref(pixbuf); // the loader owns it
+    } else if (status == DecodeStatus::done) {
+        status = DecodeStatus::failed;
+    }
+
+    g_object_unref(loader);
+    return status;
+}
+
+/**
+ * Loads the image with load_pixbuf() and converts every pixel to
+ * grayscale with the Rec. 709 luma weights, in bands of rows
+ * on pool. Any alpha channel is ignored, the same as when
+ * ImageMagick makes a .pgm file.
+ *
+ * @param[in] filename the path of the image
+ * @param[out] image the image to store the luminance values in
+ * @param[in] pool the threads to convert the pixels on
+ * @param[in] progress a function to report progress to, which can stop the decoding
+ * @return whether the image was decoded, couldn't be loaded, or was stopped
+ *
+*/
+DecodeStatus PixbufDecoder::decode(const std::string &filename, LumImage &image, ThreadPool &pool,
+                                    const ProgressFunc &progress) {
+    GdkPixbuf *pixbuf;
+    DecodeStatus status = load_pixbuf(filename, pixbuf, [&progress](double frac) {
+        return progress(0.5 * frac);
+    });
+    if (status != DecodeStatus::done) {
+        return status;
+    }
+
+    int height = gdk_pixbuf_get_height(pixbuf);
+    image.resize(gdk_pixbuf_get_width(pixbuf), height);
+
+    SharedProgress shared(progress, height, 0.5, 0.5);
+    int bands = band_count(pool, height, 64);
+
+    pool.run(bands, [&](int band) {
+        int begin = band_begin(height, bands, band);
+        int end = band_begin(height, bands, band + 1);
+
+        for (int y = begin; y < end; y += 64) { // checking in on every row would spend more time on the callback
+            int stop = std::min(y + 64, end);
+            pixbuf_rows(pixbuf, y, stop, image);
+            if (!shared.advance(stop - y)) {
+                return;
+            }
+        }
+    });
+
+    g_object_unref(pixbuf);
+    return shared.stopped() ? DecodeStatus::stopped : DecodeStatus::done;
+}
+
+/// Held while a pipe for ImageMagick is made and it's started, so no other conversion's child can inherit the pipe
+static std::mutex spawn_mutex;
+
+/**
+ * @brief Starts ImageMagick writing a .pgm file to a pipe
+ *
+ * Starts the magick command directly, without a shell, so the file
+ * name never has to be escaped. ImageMagick writes a binary .pgm
+ * file, or .ppm file if format asks for one, of the first frame of
+ * the image to its standard output.
+ * Nothing is written to disk, so any number of conversions can run
+ * at the same time.
+ *
+ * @attention The user must have ImageMagick installed
+ *
+ * @param[in] filename the path of the image
+ * @param[in] format the format to write, "pgm:-" or "ppm:-"
+ * @param[out] pid the process ID of ImageMagick
+ * @param[out] fd the end of the pipe to read the .pgm file from
+ * @return whether ImageMagick was started
+ *
+*/
+static bool spawn_magick(const std::string &filename, const char *format, pid_t &pid, int &fd) {
+    std::string input = filename + "[0]"; // only the first frame of animations
+    if (input[0] == '-') { // don't let the file name look like an option
+        input = "./" + input;
+    }
+    const char *argv[] = {"magick", input.c_str(), format, nullptr};
+
+    // a child started by another thread between pipe() and fcntl() would hold the pipe open, and the read would
+    // never see the end of the file, so the whole sequence is done one thread at a time (pipe2() isn't portable)
+    std::lock_guard<std::mutex> lock(spawn_mutex);
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+
+    int err = posix_spawnp(&pid, "magick", &actions, nullptr, const_cast<char *const *>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err != 0) {
+        close(fds[0]);
+        return false;
+    }
+
+    fd = fds[0];
+    return true;
+}
+
+/// How long a read from ImageMagick waits before checking whether it should stop, in milliseconds
+constexpr int magick_poll_ms = 20;
+
+/// How long ImageMagick gets to exit after being asked to stop before it's killed, in milliseconds
+constexpr int magick_grace_ms = 50;
+
+/**
+ * @brief Waits until there's something to read from a pipe
+ *
+ * @param[in] fd the pipe
+ * @param[in] timeout the most milliseconds to wait
+ * @return false if the time ran out, true if there's data or the other end was closed
+ *
+*/
+static bool wait_readable(int fd, int timeout) {
+    pollfd p{fd, POLLIN, 0};
+    int ready;
+    while ((ready = poll(&p, 1, timeout)) < 0 && errno == EINTR) {}
+    return ready != 0;
+}
+
+/**
+ * @brief Waits for ImageMagick to exit
+ *
+ * Asks it to stop first if it was stopped early, and kills it if
+ * it doesn't exit within magick_grace_ms, so stopping never waits
+ * on ImageMagick for long.
+ *
+ * @param[in] pid the process ID of ImageMagick
+ * @param[in] stop whether to ask it to stop instead of letting it finish
+ * @return the status from waitpid(), only meaningful if stop is false
+ *
+*/
+static int reap_magick(pid_t pid, bool stop) {
+    int wstatus = 0;
+    if (stop) {
+        kill(pid, SIGTERM);
+        for (int waited = 0; waited < magick_grace_ms; waited += 5) {
+            if (waitpid(pid, &wstatus, WNOHANG) == pid) {
+                return wstatus;
+            }
+            usleep(5000);
+        }
+        kill(pid, SIGKILL);
+    }
+    while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {}
+    return wstatus;
+}
+
+/**
+ * @brief Runs ImageMagick and collects the .pgm file it writes to a pipe
+ *
+ * Starts ImageMagick with spawn_magick() and reads the .pgm file
+ * into memory as it arrives. While ImageMagick is busy and has
+ * nothing to write, progress is still checked every
+ * magick_poll_ms, so it can be stopped at any time.
+ *
+ * @param[in] filename the path of the image
+ * @param[in] format the format to write, see spawn_magick()
+ * @param[out] output the .pgm file ImageMagick wrote
+ * @param[in] progress a function to report progress to, which can stop ImageMagick
+ * @return whether ImageMagick ran, was stopped, or failed
+ *
+*/
+static DecodeStatus run_magick(const std::string &filename, const char *format, std::vector<unsigned char> &output,
+                                const ProgressFunc &progress) {
+    pid_t pid;
+    int fd;
+    if (!spawn_magick(filename, format, pid, fd)) {
+        return DecodeStatus::failed;
+    }
+
+    DecodeStatus status = DecodeStatus::done;
+    PgmHeader header;
+    std::size_t expected = 0; // the full size of the file once the header has been read
+    std::size_t chunk = 1 << 16;
+    output.clear();
+
+    while (true) {
+        bool ready = wait_readable(fd, magick_poll_ms);
+        if (!progress(expected ? 0.5 * output.size() / expected : 0.0)) {
+            status = DecodeStatus::stopped;
+            break;
+        }
+        if (!ready) { // ImageMagick is still working
+            continue;
+        }
+
+        std::size_t used = output.size();
+        output.resize(used + chunk);
+        ssize_t count = read(fd, output.data() + used, chunk);
+        if (count < 0 && errno == EINTR) {
+            output.resize(used);
+            continue;
+        }
+        output.resize(used + std::max<ssize_t>(count, 0));
+        if (count <= 0) {
+            break;
+        }
+
+        if (expected == 0 && parse_pgm_header(output.data(), output.size(), header)) {
+            expected = header.data_offset + header.pixel_bytes();
+            output.reserve(expected);
+            chunk = 1 << 20;
+        }
+    }
+    close(fd);
+
+    int wstatus = reap_magick(pid, status == DecodeStatus::stopped);
+    if (status == DecodeStatus::done && !(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0)) {
+        status = DecodeStatus::failed;
+    }
+
+    return status;
+}
+
+/**
+ * Runs ImageMagick with run_magick() and reads the .pgm file it
+ * wrote straight out of memory.
+ *
+ * @param[in] filename the path of the image
+ * @param[out] image the image to store the luminance values in
+ * @param[in] pool the threads to read the pixels on
+ * @param[in] progress a function to report progress to, which can stop the decoding
+ * @return whether the image was decoded, couldn't be converted, or was stopped
+ *
+*/
+DecodeStatus MagickDecoder::decode(const std::string &filename, LumImage &image, ThreadPool &pool,
+                                    const ProgressFunc &progress) {
+    std::vector<unsigned char> pgm;
+    DecodeStatus status = run_magick(filename, "pgm:-", pgm, progress);
+    if (status != DecodeStatus::done) {
+        return status;
+    }
+
+    PgmHeader header;
+    if (!parse_pgm_header(pgm.data(), pgm.size(), header) || !header.binary || !header.complete(pgm.size())) {
+        return DecodeStatus::failed;
+    }
+
+    bool finished = read_p5(pgm.data(), header, image, pool, [&progress](double frac) {
+        return progress(0.5 + 0.5 * frac);
+    });
+
+    return finished ? DecodeStatus::done : DecodeStatus::stopped;
+}
+
+/**
+ * @brief A RowSource that reads rows out of a memory mapped .pgm file
+ *
+ * Rows that have been handed out are dropped from memory, so
+ * reading a huge file doesn't fill up memory with its pages.
+ *
+*/
+class PgmRowSource : public RowSource {
+    public:
+        /// The PgmRowSource constructor, maps the file at filename
+        PgmRowSource(const std::string &filename) : pgm(filename), next_row(0) {}
+
+        /// A function that returns whether the file is a binary .pgm file
+        bool open() {
+            return pgm.is_open() && parse_pgm_header(pgm.data(), pgm.size(), header) &&
+                    header.binary && header.complete(pgm.size());
+        }
+
+        int width() const override {
+            return header.width;
+        }
+
+        int height() const override {
+            return header.height;
+        }
+
+        bool read_row(unsigned char *row) override {
+            if (next_row >= header.height) {
+                return false;
+            }
+            read_p5_row(pgm.data(), header, next_row, row);
+            next_row++;
+
+            if (next_row % 256 == 0) {
+                pgm.drop(header.data_offset + header.row_bytes() * next_row);
+            }
+            return true;
+        }
+
+    private:
+        MappedFile pgm; ///< The mapped .pgm file
+        PgmHeader header; ///< The header of the .pgm file
+        int next_row; ///< The next row to hand out
+};
+
+/**
+ * @brief A RowSource that reads rows from ImageMagick as it writes them
+ *
+ * Starts ImageMagick with spawn_magick() and reads one row at a
+ * time from the pipe, so the whole image is never held in this
+ * process. ImageMagick is stopped if the source is destroyed before
+ * every row has been read.
+ *
+*/
+class MagickRowSource : public RowSource {
+    public:
+        /// The MagickRowSource constructor, starts ImageMagick on filename
+        MagickRowSource(const std::string &filename, const CancelToken *cancel) :
+            pid(-1), fd(-1), buffered(0), cancel(cancel) {
+            if (!spawn_magick(filename, "pgm:-", pid, fd)) {
+                pid = -1;
+                fd = -1;
+            }
+        }
+
+        ~MagickRowSource() override {
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (pid > 0) {
+                reap_magick(pid, true); // does nothing if it has already finished
+            }
+        }
+
+        /// A function that reads the header and returns whether it's a binary .pgm file
+        bool open() {
+            if (fd < 0) {
+                return false;
+            }
+            buffer.resize(1024); // headers are tiny, but comments could make them any length
+            while (!parse_pgm_header(buffer.data(), buffered, header)) {
+                if (buffered == buffer.size() || !fill(buffered + 1)) {
+                    return false;
+                }
+            }
+            if (!header.binary) {
+                return false;
+            }
+
+            buffer.erase(buffer.begin(), buffer.begin() + header.data_offset); // keep any pixels read with the header
+            buffered -= header.data_offset;
+            row_size = header.row_bytes();
+            buffer.resize(std::max(row_size, buffered));
+            return true;
+        }
+
+        int width() const override {
+            return header.width;
+        }
+
+        int height() const override {
+            return header.height;
+        }
+
+        bool read_row(unsigned char *row) override {
+            if (!fill(row_size)) {
+                return false;
+            }
+
+            PgmHeader row_header = header;
+            row_header.data_offset = 0;
+            read_p5_row(buffer.data(), row_header, 0, row);
+
+            buffer.erase(buffer.begin(), buffer.begin() + row_size);
+            buffered -= row_size;
+            buffer.resize(std::max(row_size, buffered));
+            return true;
+        }
+
+    private:
+        /// A function to read from the pipe until at least size bytes are buffered, false if it ends or is cancelled
+        bool fill(std::size_t size) {
+            while (buffered < size) {
+                while (!wait_readable(fd, magick_poll_ms) && !cancelled(cancel)) {}
+                if (cancelled(cancel)) {
+                    return false;
+                }
+                ssize_t count = read(fd, buffer.data() + buffered, buffer.size() - buffered);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) {
+                    return false;
+                }
+                buffered += count;
+            }
+            return true;
+        }
+
+        pid_t pid; ///< The process ID of ImageMagick
+        int fd; ///< The end of the pipe ImageMagick writes to
+        PgmHeader header; ///< The header of the .pgm file ImageMagick writes
+        std::vector<unsigned char> buffer; ///< Bytes read from the pipe that haven't been used yet
+        std::size_t buffered; ///< The number of bytes in buffer that hold data
+        std::size_t row_size = 0; ///< The number of bytes in one row of pixels
+        const CancelToken *cancel; ///< Checked while waiting for ImageMagick, may be nullptr
+};
+
+/**
+ * @brief Opens an image as a stream of rows
+ *
+ * Binary .pgm files are read straight out of a memory mapping.
+ * Anything else is streamed out of ImageMagick, because GdkPixbuf
+ * always decodes the whole image at once.
+ *
+ * @param[in] filename the path of the image
+ * @param[in] cancel checked while waiting for ImageMagick, may be nullptr
+ * @return the rows of the image, or nullptr if it can't be read
+ *
+*/
+std::unique_ptr<RowSource> open_row_source(const std::string &filename, const CancelToken *cancel) {
+    auto pgm = std::make_unique<PgmRowSource>(filename);
+    if (pgm->open()) {
+        return pgm;
+    }
+
+    auto magick = std::make_unique<MagickRowSource>(filename, cancel);
+    if (magick->open()) {
+        return magick;
+    }
+
+    return nullptr;
+}
+
+/// The shortest delay a frame of an animation gets, since some GIFs ask for none at all
+constexpr int min_frame_delay_ms = 20;
+
+/// How many seconds the last frame of an animation that doesn't loop is shown for
+constexpr double last_frame_seconds = 0.1;
+
+/**
+ * @brief A FrameSource for the animated images GdkPixbuf can read
+ *
+ * A class that steps a GdkPixbufAnimationIter through an animation
+ * by the delay of each frame instead of by the clock, so every
+ * frame comes out once however long it takes to convert it. An
+ * animation that loops forever never runs out of frames.
+ *
+*/
+class PixbufFrameSource : public FrameSource {
+    public:
+        /// The PixbufFrameSource constructor, takes over the reference to animation
+        PixbufFrameSource(GdkPixbufAnimation *animation) : animation(animation), iter(nullptr), time{0, 0}, ended(false) {
+            G_GNUC_BEGIN_IGNORE_DEPRECATIONS // GTimeVal is the only way to give the iterator a time of our own
+            iter = gdk_pixbuf_animation_get_iter(animation, &time);
+            G_GNUC_END_IGNORE_DEPRECATIONS
+        }
+
+        ~PixbufFrameSource() override {
+            if (iter) {
+                g_object_unref(iter);
+            }
+            g_object_unref(animation);
+        }
+
+        int width() const override {
+            return gdk_pixbuf_animation_get_width(animation);
+        }
+
+        int height() const override {
+            return gdk_pixbuf_animation_get_height(animation);
+        }
+
+        bool next(LumImage &frame, double &duration) override {
+            if (ended || !iter) {
+                return false;
+            }
+            const GdkPixbuf *pixbuf = gdk_pixbuf_animation_iter_get_pixbuf(iter);
+            if (!pixbuf || gdk_pixbuf_get_width(pixbuf) != width() || gdk_pixbuf_get_height(pixbuf) != height()) {
+                return false;
+            }
+            frame.resize(width(), height());
+            pixbuf_rows(pixbuf, 0, height(), frame);
+
+            int delay = gdk_pixbuf_animation_iter_get_delay_time(iter);
+            if (delay < 0) { // the last frame of an animation that doesn't loop
+                ended = true;
+                duration = last_frame_seconds;
+                return true;
+            }
+            delay = std::max(delay, min_frame_delay_ms);
+            duration = delay / 1000.0;
+
+            time.tv_usec += delay * 1000L;
+            time.tv_sec += time.tv_usec / 1000000;
+            time.tv_usec %= 1000000;
+            G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+            gdk_pixbuf_animation_iter_advance(iter, &time);
+            G_GNUC_END_IGNORE_DEPRECATIONS
+            return true;
+        }
+
+    private:
+        GdkPixbufAnimation *animation; ///< The animation
+        GdkPixbufAnimationIter *iter; ///< Where the animation is up to
+        GTimeVal time; ///< The time the iterator is at, counting from 0 at the first frame
+        bool ended; ///< Whether the last frame of an animation that doesn't loop has been read
+};
+
+/**
+ * @brief Opens an animated image as a stream of frames
+ *
+ * Only GIF and WebP files are tried, because loading anything
+ * else as an animation would decode the whole image just to find
+ * that it has one frame. Those are fed to a GdkPixbufLoader a
+ * piece at a time, the same as a still image, so opening a large
+ * one can be stopped halfway.
+ *
+ * @param[in] filename the path of the image
+ * @param[in] cancel checked between the pieces of the file
+ * @return the frames of the image, or nullptr if it isn't an animation GdkPixbuf can read or it was stopped
+ *
+*/
+std::unique_ptr<FrameSource> open_animation(const std::string &filename, const CancelToken *cancel) {
+    GdkPixbufFormat *format = gdk_pixbuf_get_file_info(filename.c_str(), nullptr, nullptr);
+    if (!format) {
+        return nullptr;
+    }
+    gchar *name = gdk_pixbuf_format_get_name(format);
+    bool animated = name && (std::string(name) == "gif" || std::string(name) == "webp");
+    g_free(name);
+    if (!animated) {
+        return nullptr;
+    }
+
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    DecodeStatus status = feed_loader(filename, loader, [cancel](double frac) {
+        return !cancelled(cancel);
+    });
+    GdkPixbufAnimation *animation = status == DecodeStatus::done ? gdk_pixbuf_loader_get_animation(loader) : nullptr;
+    if (animation && gdk_pixbuf_animation_is_static_image(animation)) {
+        animation = nullptr;
+    }
+    if (animation) {
+        g_object_ref(animation); // the loader owns it
+    }
+    g_object_unref(loader);
+    return animation ? std::make_unique<PixbufFrameSource>(animation) : nullptr;
+}
+
+/**
+ * @brief A FrameSource for raw 8-bit gray frames
+ *
+ * A class that reads frames of width by height bytes, one after
+ * another with no headers, from a pipe or file, like the rawvideo
+ * output of a video decoder with a gray pixel format. It waits for
+ * data in short steps, so it can be stopped while the pipe is idle.
+ *
+*/
+class RawFrameSource : public FrameSource {
+    public:
+        /// The RawFrameSource constructor, the frames are read from fd at fps frames per second
+        RawFrameSource(int fd, int width, int height, double fps, const CancelToken *cancel) :
+            fd(fd), w(width), h(height), fps(fps), buffer((std::size_t)width * height), cancel(cancel) {}
+
+        int width() const override {
+            return w;
+        }
+
+        int height() const override {
+            return h;
+        }
+
+        bool next(LumImage &frame, double &duration) override {
+            std::size_t filled = 0;
+            while (filled < buffer.size()) {
+                while (!wait_readable(fd, magick_poll_ms) && !cancelled(cancel)) {}
+                if (cancelled(cancel)) {
+                    return false;
+                }
+                ssize_t count = read(fd, buffer.data() + filled, buffer.size() - filled);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count <= 0) { // the end of the stream, and any partial frame is dropped
+                    return false;
+                }
+                filled += count;
+            }
+
+            frame.resize(w, h);
+            for (int y = 0; y < h; y++) {
+                std::memcpy(frame.row(y), buffer.data() + (std::size_t)y * w, w);
+            }
+            duration = 1.0 / fps;
+            return true;
+        }
+
+    private:
+        int fd; ///< The pipe or file the frames are read from
+        int w; ///< The width of every frame
+        int h; ///< The height of every frame
+        double fps; ///< The frames per second the frames were made at
+        std::vector<unsigned char> buffer; ///< The frame being read
+        const CancelToken *cancel; ///< Checked while waiting for data, may be nullptr
+};
+
+/**
+ * @param[in] fd the pipe or file to read from, which stays open
+ * @param[in] width the width of every frame
+ * @param[in] height the height of every frame
+ * @param[in] fps the frames per second the frames were made at
+ * @param[in] cancel checked while waiting for data, may be nullptr
+ * @return the frames, or nullptr if the size or rate isn't valid
+ *
+*/
+std::unique_ptr<FrameSource> open_raw_frames(int fd, int width, int height, double fps, const CancelToken *cancel) {
+    if (fd < 0 || width <= 0 || height <= 0 || fps <= 0) {
+        return nullptr;
+    }
+    return std::make_unique<RawFrameSource>(fd, width, height, fps, cancel);
+}
+
+/**
+ * @brief Decodes an image with the first Decoder that can read it
+ *
+ * Tries a PgmDecoder, then a PixbufDecoder, and only runs
+ * ImageMagick through a MagickDecoder if neither of them could
+ * read the file.
+ *
+ * @param[in] filename the path of the image
+ * @param[out] image the image to store the luminance values in
+ * @param[in] pool the threads to decode on
+ * @param[in] progress a function to report progress to, which can stop the decoding
+ * @return whether the image was decoded, couldn't be read at all, or was stopped
+ *
+*/
+DecodeStatus decode_image(const std::string &filename, LumImage &image, ThreadPool &pool,
+                            const ProgressFunc &progress) {
+    static PgmDecoder pgm_decoder;
+    static PixbufDecoder pixbuf_decoder;
+    static MagickDecoder magick_decoder;
+    Decoder *decoders[] = {&pgm_decoder, &pixbuf_decoder, &magick_decoder};
+
+    for (Decoder *decoder : decoders) {
+        DecodeStatus status = decoder->decode(filename, image, pool, progress);
+        if (status != DecodeStatus::failed) {
+            return status;
+        }
+    }
+
+    return DecodeStatus::failed;
+}
+
+/**
+ * @brief Reads every pixel of a binary .pgm or .ppm file in color
+ *
+ * Reads the rows with read_rgb_row() in bands on pool, the same
+ * way read_p5() reads luminance values.
+ *
+ * @param[in] data the contents of the file
+ * @param[in] header the header read by parse_pgm_header()
+ * @param[out] image the image to store the colors in
+ * @param[in] pool the threads to read the bands on
+ * @param[in] progress a function to report progress to, which can stop the reading
+ * @return false if the reading was stopped
+ *
+*/
+static bool read_rgb(const unsigned char *data, const PgmHeader &header, RgbImage &image, ThreadPool &pool,
+                        const ProgressFunc &progress) {
+    image.resize(header.width, header.height);
+
+    SharedProgress shared(progress, header.height);
+    int bands = band_count(pool, header.height, 64);
+
+    pool.run(bands, [&](int band) {
+        int begin = band_begin(header.height, bands, band);
+        int end = band_begin(header.height, bands, band + 1);
+
+        for (int y = begin; y < end; y++) {
+            read_rgb_row(data, header, y, image.planes[0].row(y), image.planes[1].row(y), image.planes[2].row(y));
+            if ((y - begin) % 64 == 63 && !shared.advance(64)) {
+                return;
+            }
+        }
+        shared.advance((end - begin) % 64);
+    });
+
+    return !shared.stopped();
+}
+
+/**
+ * @brief Copies rows of a GdkPixbuf into an RgbImage
+ *
+ * Ignores any alpha channel, like pixbuf_rows().
+ *
+ * @param[in] pixbuf the pixbuf to copy
+ * @param[in] begin the first row to copy
+ * @param[in] end the row after the last row to copy
+ * @param[out] image an image the size of pixbuf to store the colors in
+ *
+*/
+static void pixbuf_rgb_rows(const GdkPixbuf *pixbuf, int begin, int end, RgbImage &image) {
+    int width = gdk_pixbuf_get_width(pixbuf);
+    int rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    int channels = gdk_pixbuf_get_n_channels(pixbuf);
+    const guchar *pixels = gdk_pixbuf_read_pixels(pixbuf);
+
+    for (int y = begin; y < end; y++) {
+        const guchar *src = pixels + (std::size_t)y * rowstride;
+        unsigned char *red = image.planes[0].row(y);
+        unsigned char *green = image.planes[1].row(y);
+        unsigned char *blue = image.planes[2].row(y);
+        for (int x = 0; x < width; x++) {
+            red[x] = src[x * channels];
+            green[x] = src[x * channels + 1];
+            blue[x] = src[x * channels + 2];
+        }
+    }
+}
+
+/**
+ * @brief Decodes an image in color
+ *
+ * Tries the same ways as decode_image(), in the same order, but
+ * keeps the red, green and blue values apart. Binary .pgm and .ppm
+ * files are read out of a memory mapping, then GdkPixbuf is tried,
+ * and last of all ImageMagick writes a .ppm file to a pipe. Gray
+ * images come out with the same value in every plane.
+ *
+ * @param[in] filename the path of the image
+ * @param[out] image the image to store the colors in
+ * @param[in] pool the threads to decode on
+ * @param[in] progress a function to report progress to, which can stop the decoding
+ * @return whether the image was decoded, couldn't be read at all, or was stopped
+ *
+*/
+DecodeStatus decode_color(const std::string &filename, RgbImage &image, ThreadPool &pool,
+                            const ProgressFunc &progress) {
+    {
+        MappedFile pnm(filename);
+        PgmHeader header;
+        if (pnm.is_open() && parse_pgm_header(pnm.data(), pnm.size(), header) && header.binary &&
+            header.complete(pnm.size())) {
+            return read_rgb(pnm.data(), header, image, pool, progress) ? DecodeStatus::done : DecodeStatus::stopped;
+        }
+    }
+
+    GdkPixbuf *pixbuf;
+    DecodeStatus status = load_pixbuf(filename, pixbuf, [&progress](double frac) {
+        return progress(0.5 * frac);
+    });
+    if (status == DecodeStatus::done) {
+        int height = gdk_pixbuf_get_height(pixbuf);
+        image.resize(gdk_pixbuf_get_width(pixbuf), height);
+
+        SharedProgress shared(progress, height, 0.5, 0.5);
+        int bands = band_count(pool, height, 64);
+        pool.run(bands, [&](int band) {
+            int begin = band_begin(height, bands, band);
+            int end = band_begin(height, bands, band + 1);
+            for (int y = begin; y < end; y += 64) {
+                int stop = std::min(y + 64, end);
+                pixbuf_rgb_rows(pixbuf, y, stop, image);
+                if (!shared.advance(stop - y)) {
+                    return;
+                }
+            }
+        });
+
+        g_object_unref(pixbuf);
+        return shared.stopped() ? DecodeStatus::stopped : DecodeStatus::done;
+    }
+    if (status == DecodeStatus::stopped) {
+        return status;
+    }
+
+    std::vector<unsigned char> ppm;
+    status = run_magick(filename, "ppm:-", ppm, progress);
+    if (status != DecodeStatus::done) {
+        return status;
+    }
+
+    PgmHeader header;
+    if (!parse_pgm_header(ppm.data(), ppm.size(), header) || !header.binary || !header.complete(ppm.size())) {
+        return DecodeStatus::failed;
+    }
+
+    bool finished = read_rgb(ppm.data(), header, image, pool, [&progress](double frac) {
+        return progress(0.5 + 0.5 * frac);
+    });
+
+    return finished ? DecodeStatus::done : DecodeStatus::stopped;
+}
+
+/**
+ * @brief Reads the size of an image without decoding it
+ *
+ * Reads the header of a .pgm file, or asks GdkPixbuf, which only
+ * reads as much of the file as it needs to find the size.
+ *
+ * @param[in] filename the path of the image
+ * @param[out] width the width of the image
+ * @param[out] height the height of the image
+ * @return false if neither could read the size
+ *
+*/
+bool image_size(const std::string &filename, int &width, int &height) {
+    MappedFile pgm(filename);
+    PgmHeader header;
+    if (pgm.is_open() && parse_pgm_header(pgm.data(), pgm.size(), header)) {
+        width = header.width;
+        height = header.height;
+        return true;
+    }
+
+    return gdk_pixbuf_get_file_info(filename.c_str(), &width, &height) != nullptr;
+}
+
+/**
+ * @brief Quickly decodes a rough version of an image
+ *
+ * Only works where a rough version is much cheaper than the whole
+ * image. Binary .pgm files are sampled straight out of a memory
+ * mapping, one pixel per output pixel, and JPEG files are decoded
+ * by GdkPixbuf at a reduced scale, which skips most of the work.
+ * Anything else returns false, because it would have to be fully
+ * decoded anyway.
+ *
+ * @param[in] filename the path of the image
+ * @param[in] destw the width of the preview
+ * @param[in] desth the height of the preview
+ * @param[out] image the preview, resized to destw by desth
+ * @return false if there's no quick way to make a preview
+ *
+*/
+bool decode_preview(const std::string &filename, int destw, int desth, LumImage &image) {
+    MappedFile pgm(filename);
+    PgmHeader header;
+    if (pgm.is_open() && parse_pgm_header(pgm.data(), pgm.size(), header)) {
+        if (!header.binary || header.channels != 1 || !header.complete(pgm.size()) || header.maxval > 255) {
+            return false;
+        }
+
+        image.resize(destw, desth);
+        for (int j = 0; j < desth; j++) {
+            const unsigned char *src = pgm.data() + header.data_offset +
+                                        (std::size_t)((j + 0.5) * header.height / desth) * header.width;
+            unsigned char *dst = image.row(j);
+            for (int i = 0; i < destw; i++) {
+                unsigned int value = src[(std::size_t)((i + 0.5) * header.width / destw)];
+                dst[i] = std::min((value * 255 + header.maxval / 2) / header.maxval, 255u);
+            }
+        }
+        return true;
+    }
+
+    int width, height;
+    GdkPixbufFormat *format = gdk_pixbuf_get_file_info(filename.c_str(), &width, &height);
+    if (!format) {
+        return false;
+    }
+    gchar *name = gdk_pixbuf_format_get_name(format);
+    bool jpeg = name && std::string(name) == "jpeg"; // the only loader that decodes less at a smaller scale
+    g_free(name);
+    if (!jpeg) {
+        return false;
+    }
+
+    GError *error = nullptr;
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_file_at_scale(filename.c_str(), destw, desth, FALSE, &error);
+    if (!pixbuf) {
+        g_clear_error(&error);
+        return false;
+    }
+
+    image.resize(gdk_pixbuf_get_width(pixbuf), gdk_pixbuf_get_height(pixbuf));
+    pixbuf_rows(pixbuf, 0, image.height(), image);
+    g_object_unref(pixbuf);
+    return true;
+}
@@ -0,0 +1,106 @@
+#include <memory>
+#include <string>
+#include "pgm.hpp"
+#include "cancel.hpp"
+
+class RowSource;
+class FrameSource;
+
+#pragma once
+
+/**
+ * @file decoder.hpp
+ *
+*/
+
+/// The ways a Decoder can finish
+enum class DecodeStatus {
+    done, ///< The image was decoded
+    failed, ///< The decoder couldn't read the image, so another decoder should try
+    stopped ///< The progress function asked the decoder to stop
+};
+
+/**
+ * @brief A class that turns image files into luminance values
+ *
+ * A base class for the different ways of decoding an image
+ * file into 0-255 grayscale values that Worker::work() can
+ * convert to ASCII.
+ *
+*/
+class Decoder {
+    public:
+        virtual ~Decoder() = default; ///< The Decoder destructor
+
+        /// A function to decode the image at filename into image
+        virtual DecodeStatus decode(const std::string &filename, LumImage &image, ThreadPool &pool,
+                                    const ProgressFunc &progress) = 0;
+};
+
+/**
+ * @brief A Decoder for files that are already .pgm files
+ *
+ * Memory maps the file and reads the pixels straight out of it.
+ *
+*/
+class PgmDecoder : public Decoder {
+    public:
+        /// A function to decode the .pgm file at filename into image
+        DecodeStatus decode(const std::string &filename, LumImage &image, ThreadPool &pool,
+                            const ProgressFunc &progress) override;
+};
+
+/**
+ * @brief A Decoder that uses GdkPixbuf inside the process
+ *
+ * Loads the image with GdkPixbuf, which comes with gtkmm, and
+ * converts the pixels to grayscale without starting any other
+ * processes or writing any files.
+ *
+*/
+class PixbufDecoder : public Decoder {
+    public:
+        /// A function to decode the image at filename into image
+        DecodeStatus decode(const std::string &filename, LumImage &image, ThreadPool &pool,
+                            const ProgressFunc &progress) override;
+};
+
+/**
+ * @brief A Decoder that runs ImageMagick
+ *
+ * The fallback for any format GdkPixbuf can't load. ImageMagick
+ * writes a .pgm file to a pipe, which is read straight into memory
+ * without touching the disk.
+ *
+ * @attention The user must have ImageMagick installed
+ *
+*/
+class MagickDecoder : public Decoder {
+    public:
+        /// A function to decode the image at filename into image
+        DecodeStatus decode(const std::string &filename, LumImage &image, ThreadPool &pool,
+                            const ProgressFunc &progress) override;
+};
+
+/// A function to decode an image with the first Decoder that can read it
+DecodeStatus decode_image(const std::string &filename, LumImage &image, ThreadPool &pool,
+                            const ProgressFunc &progress);
+
+/// A function to decode an image into red, green and blue values instead of luminance
+DecodeStatus decode_color(const std::string &filename, RgbImage &image, ThreadPool &pool,
+                            const ProgressFunc &progress);
+
+/// A function to read the size of an image without decoding it
+bool image_size(const std::string &filename, int &width, int &height);
+
+/// A function to quickly decode a rough destw by desth version of an image, false if there's no quick way
+bool decode_preview(const std::string &filename, int destw, int desth, LumImage &image);
+
+/// A function to open an image as a stream of rows, for converting images too big to hold in memory
+std::unique_ptr<RowSource> open_row_source(const std::string &filename, const CancelToken *cancel = nullptr);
+
+/// A function to open an animated GIF or WebP image as a stream of frames, nullptr if it isn't one or it was stopped
+std::unique_ptr<FrameSource> open_animation(const std::string &filename, const CancelToken *cancel = nullptr);
+
+/// A function to read raw 8-bit gray frames of width by height from fd, nullptr if the size or rate isn't valid
+std::unique_ptr<FrameSource> open_raw_frames(int fd, int width, int height, double fps, const CancelToken *cancel = nullptr);
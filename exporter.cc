@@ -0,0 +1,281 @@
+#include "exporter.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+
+/**
+ * @file exporter.cc
+ *
+*/
+
+/// An rtf file header with the correct settings for an ASCII art image
+static const char rtf_header[] = R"({\rtf1\ansi\ansicpg1252\cocoartf2761
+\cocoatextscaling0\cocoaplatform0{\fonttbl\f0\fnil\fcharset0 Menlo-Regular;}
+{\colortbl;\red255\green255\blue255;}
+{\*\expandedcolortbl;;}
+\margl1440\margr1440\vieww17700\viewh9340\viewkind0
+\deftab720
+\pard\tx720\tx1440\tx2160\tx2880\tx3600\tx4320\tx5040\tx5760\tx6480\tx7200\tx7920\tx8640\pardeftab720\sl144\slmult1\pardirnatural\partightenfactor0
+
+\f0\fs2 \cf0 )";
+// I got the header myself, not from another source.
+
+/**
+ * @brief An exporter that writes the text as it is
+ *
+ * Used for plain text, and for text that's already in the format
+ * it's saved as, like text colored with ANSI escapes.
+ *
+*/
+class TextExporter : public Exporter {
+    public:
+        void convert(const char *text, std::size_t size, std::string &out) override {
+            out.append(text, size);
+        }
+};
+
+/**
+ * @brief An exporter that writes Rich Text Format
+ *
+ * Puts a backslash before newlines, braces and backslashes, so
+ * the text can go straight into an RTF file. Runs of characters
+ * that don't need one are appended at once, instead of a
+ * character at a time.
+ *
+*/
+class RtfExporter : public Exporter {
+    public:
+        void begin(std::string &out) override {
+            out += rtf_header;
+        }
+
+        void convert(const char *text, std::size_t size, std::string &out) override {
+            std::size_t run = 0; // where the characters that haven't been appended yet begin
+            for (std::size_t i = 0; i < size; i++) {
+                const char c = text[i];
+                if (c == '\n' || c == '{' || c == '}' || c == '\\') {
+                    out.append(text + run, i - run);
+                    out += '\\';
+                    run = i; // the character itself goes with the next run
+                }
+            }
+            out.append(text + run, size - run);
+        }
+
+        void end(std::string &out) override {
+            out += "}\n";
+        }
+};
+
+/**
+ * @brief An exporter that writes a web page
+ *
+ * Puts the text in a pre block in a monospace font, with the
+ * characters HTML gives a meaning to escaped.
+ *
+*/
+class HtmlExporter : public Exporter {
+    public:
+        void begin(std::string &out) override {
+            out += "<pre style=\"font-family:monospace;line-height:1\">";
+        }
+
+        void convert(const char *text, std::size_t size, std::string &out) override {
+            std::size_t run = 0;
+            for (std::size_t i = 0; i < size; i++) {
+                const char c = text[i];
+                if (c == '<' || c == '>' || c == '&') {
+                    out.append(text + run, i - run);
+                    out += c == '<' ? "&lt;" : c == '>' ? "&gt;" : "&amp;";
+                    run = i + 1;
+                }
+            }
+            out.append(text + run, size - run);
+        }
+
+        void end(std::string &out) override {
+            out += "</pre>\n";
+        }
+};
+
+/**
+ * Makes the exporter for a format. Art that isn't colored
+ * has nothing for ANSI escapes to add, so it's exported as
+ * plain text.
+ *
+ * @param[in] format the format to export in
+ * @return the exporter
+ *
+*/
+std::unique_ptr<Exporter> make_exporter(ExportFormat format) {
+    switch (format) {
+        case ExportFormat::rtf:
+            return std::make_unique<RtfExporter>();
+        case ExportFormat::html:
+            return std::make_unique<HtmlExporter>();
+        case ExportFormat::text:
+        case ExportFormat::ansi:
+            break;
+    }
+    return std::make_unique<TextExporter>();
+}
+
+/**
+ * Picks the format to export in by the extension of the file,
+ * ignoring case.
+ *
+ * @param[in] path the file to export to
+ * @param[in] fallback the format if the extension isn't .rtf, .txt, .html, .htm or .ans
+ * @return the format
+ *
+*/
+ExportFormat export_format(const std::string &path, ExportFormat fallback) {
+    std::string extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if (extension == ".rtf") {
+        return ExportFormat::rtf;
+    } else if (extension == ".txt") {
+        return ExportFormat::text;
+    } else if (extension == ".html" || extension == ".htm") {
+        return ExportFormat::html;
+    } else if (extension == ".ans") {
+        return ExportFormat::ansi;
+    }
+    return fallback;
+}
+
+/**
+ * @brief Saves art to a file
+ *
+ * Converts the art export_chunk bytes at a time and writes each
+ * piece before converting the next, so the converted file never
+ * has to fit in memory and the buffer for it is only allocated
+ * once. A file that was stopped halfway, or couldn't be written
+ * in full, is removed.
+ *
+ * @param[in] art the art to save
+ * @param[in,out] exporter converts the art to the format of the file
+ * @param[in] path the file to save to, which is replaced
+ * @param[in] cancel checked after every piece
+ * @param[in] progress a function to report progress to after every piece, which can stop the export
+ * @return false if it was stopped or the file couldn't be written
+ *
+*/
+bool export_art(const std::string &art, Exporter &exporter, const std::string &path, const CancelToken *cancel,
+                const ProgressFunc &progress) {
+    std::ofstream file(path, std::fstream::out | std::fstream::trunc | std::fstream::binary);
+    if (!file) {
+        return false;
+    }
+
+    std::string out;
+    out.reserve(export_chunk * 2); // room for every character to be escaped, most of the time
+    exporter.begin(out);
+
+    for (std::size_t done = 0; done < art.size();) {
+        const std::size_t size = std::min(export_chunk, art.size() - done);
+        exporter.convert(art.data() + done, size, out);
+        file.write(out.data(), out.size());
+        out.clear();
+        done += size;
+
+        if (!file || cancelled(cancel) || !progress((double)done / art.size())) {
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(path, error); // half a file is no use to anyone
+            return false;
+        }
+    }
+
+    exporter.end(out);
+    file.write(out.data(), out.size());
+    file.close();
+    if (file.fail()) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+        return false;
+    }
+    return true;
+}
+
+/***/
+ExportTask::ExportTask() : thread(), cancel(), busy(false), donefrac(1.0), succeeded(true) {}
+
+/**
+ * Stops the running export, which removes the half written
+ * file, and waits for its thread to return.
+ *
+*/
+ExportTask::~ExportTask() {
+    cancel.cancel();
+    join();
+}
+
+/**
+ * Starts exporting art on a thread of its own. The art is shared,
+ * not copied, so the export goes on even if newer art replaces it.
+ * notify is called from that thread, after every piece and once
+ * more when it's over, so it has to be safe to call from any
+ * thread, like Glib::Dispatcher::emit().
+ *
+ * @param[in] art the art to save
+ * @param[in] exporter converts the art to the format of the file
+ * @param[in] path the file to save to, which is replaced
+ * @param[in] notify a function to call when there's progress to show or the export is over
+ * @return false if an export is already running, in which case nothing is started
+ *
+*/
+bool ExportTask::start(ArtBuffer art, std::unique_ptr<Exporter> exporter, const std::string &path, std::function<void()> notify) {
+    if (busy.load() || !art || !exporter) {
+        return false;
+    }
+    join(); // the last export is over, but its thread may not have returned
+
+    cancel.reset();
+    donefrac.store(0.0, std::memory_order_relaxed);
+    busy.store(true);
+    thread = std::thread([this, art = std::move(art), exporter = std::move(exporter), path, notify = std::move(notify)] {
+        bool worked = export_art(*art, *exporter, path, &cancel, [&](double frac) {
+            donefrac.store(frac, std::memory_order_relaxed);
+            notify();
+            return true;
+        });
+        succeeded.store(worked);
+        donefrac.store(1.0, std::memory_order_relaxed);
+        busy.store(false);
+        notify();
+    });
+    return true;
+}
+
+/**
+ * @return whether an export is running
+ *
+*/
+bool ExportTask::running() const {
+    return busy.load();
+}
+
+/**
+ * Sets how far the running export has got, and whether
+ * the last one that ended worked. Both are atomics, so
+ * this never waits for the export.
+ *
+ * @param[in,out] donefrac a pointer to the fraction of the art that's been written
+ * @param[in,out] succeeded a pointer to whether the last export that ended worked
+ *
+*/
+void ExportTask::get_progress(double *donefrac, bool *succeeded) const {
+    if (donefrac)
+        *donefrac = this->donefrac.load(std::memory_order_relaxed);
+    if (succeeded)
+        *succeeded = this->succeeded.load();
+}
+
+void ExportTask::join() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
@@ -0,0 +1,86 @@
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include "art.hpp"
+#include "cancel.hpp"
+#include "pgm.hpp"
+
+#pragma once
+
+/**
+ * @file exporter.hpp
+ *
+*/
+
+/// The formats art can be exported in
+enum class ExportFormat {
+    rtf, ///< Rich Text Format, in a tiny monospace font
+    text, ///< The text as it is
+    html, ///< A web page with the text in a pre block
+    ansi, ///< Text for a terminal, which is the text as it is unless it was colored with ANSI escapes
+};
+
+/// The size of the pieces art is exported in, so the whole file never has to be built in memory
+constexpr std::size_t export_chunk = 1 << 20;
+
+/**
+ * @brief A class that turns art into a file format
+ *
+ * A base class for the formats art can be saved in. The art is
+ * handed over a piece at a time, and each piece is appended to a
+ * string that's written out before the next one, so exporting
+ * never needs more than a piece of the file in memory. Pieces can
+ * end anywhere, even in the middle of a line, so an exporter only
+ * ever looks at one character at a time.
+ *
+*/
+class Exporter {
+    public:
+        virtual ~Exporter() = default; ///< The Exporter destructor
+
+        virtual void begin(std::string &out) {} ///< A function to append what comes before the art
+        /// A function to append a piece of the art, converted to the format
+        virtual void convert(const char *text, std::size_t size, std::string &out) = 0;
+        virtual void end(std::string &out) {} ///< A function to append what comes after the art
+};
+
+/// A function to make the exporter for a format
+std::unique_ptr<Exporter> make_exporter(ExportFormat format);
+/// A function to pick a format by the extension of path, or fallback if it doesn't have a known one
+ExportFormat export_format(const std::string &path, ExportFormat fallback);
+/// A function to convert art and write it to path a piece at a time, false if it was stopped or couldn't be written
+bool export_art(const std::string &art, Exporter &exporter, const std::string &path, const CancelToken *cancel,
+                const ProgressFunc &progress);
+
+/**
+ * @brief A class that exports art on a thread of its own
+ *
+ * A class that runs export_art() on a thread, so saving even huge
+ * art never freezes the window. Its progress can be read at any
+ * time, and it calls a function when there's progress to show or
+ * the export is over. It only runs one export at a time.
+ *
+*/
+class ExportTask {
+    public:
+        ExportTask(); ///< The ExportTask constructor
+        ~ExportTask(); ///< The ExportTask destructor, stops the export and waits for it
+
+        /// A function to start exporting, which keeps art alive until it's done, false if an export is already running
+        bool start(ArtBuffer art, std::unique_ptr<Exporter> exporter, const std::string &path, std::function<void()> notify);
+        bool running() const; ///< A function that returns whether an export is running
+        /// A function to get how far the export has got, and whether the last one that ended worked
+        void get_progress(double *donefrac, bool *succeeded) const;
+
+    private:
+        void join(); ///< A function to wait for the thread of the last export, if there is one
+
+        std::thread thread; ///< The thread the export runs on
+        CancelToken cancel; ///< Stops the export when the ExportTask is destroyed
+        std::atomic<bool> busy; ///< Whether an export is running
+        std::atomic<double> donefrac; ///< The fraction of the art that's been written
+        std::atomic<bool> succeeded; ///< Whether the last export that ended worked
+};
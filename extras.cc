@@ -13,10 +13,21 @@
  * layout and widgets, and connects the signals to the appropriate functions.
  * 
 */
-SettingsWindow::SettingsWindow() : vbox(Gtk::Orientation::VERTICAL), hbox(Gtk::Orientation::HORIZONTAL), close_button("Close"),
+SettingsWindow::SettingsWindow() : vbox(Gtk::Orientation::VERTICAL), hbox(Gtk::Orientation::HORIZONTAL),
+        cache_hbox(Gtk::Orientation::HORIZONTAL), filter_hbox(Gtk::Orientation::HORIZONTAL),
+        aspect_hbox(Gtk::Orientation::HORIZONTAL), threads_hbox(Gtk::Orientation::HORIZONTAL),
+        ramp_hbox(Gtk::Orientation::HORIZONTAL), color_hbox(Gtk::Orientation::HORIZONTAL), close_button("Close"),
     max_scale_factor_adj(Gtk::Adjustment::create(10.0, 1.0, 100.0, 1.0, 5.0, 0.0)),
         max_scale_factor_label("Max Scale Factor:"), size_limit_button("Image Size Restricted\nBy Screen (Dangerous)"),
-        dark_mode_button("Dark Mode") {
+        dark_mode_button("Dark Mode"), low_memory_button("Low Memory Mode\n(For Huge Images)"),
+        progressive_button("Progressive Preview"), shapes_button("Match Shapes"),
+        animate_button("Play Animations"), cache_size_label("Cache Size (MB):"),
+        cache_size_adj(Gtk::Adjustment::create(s.cache_size, 0.0, 16384.0, 64.0, 256.0, 0.0)),
+        char_aspect_label("Character Aspect:"), char_aspect_adj(Gtk::Adjustment::create(s.char_aspect, 0.5, 4.0, 0.1, 0.5, 0.0)),
+        threads_label("Threads:"), threads_adj(Gtk::Adjustment::create(s.threads, 1.0, 256.0, 1.0, 4.0, 0.0)),
+        filter_label("Scaling Filter:"), filter_dropdown({"Area", "Bilinear", "Lanczos"}),
+        ramp_label("Characters:"), color_label("Color:"),
+        color_dropdown({"None", "ANSI 24-bit", "ANSI 256", "HTML"}) {
 
 
     set_title("Settings");
@@ -51,6 +62,82 @@ SettingsWindow::SettingsWindow() : vbox(Gtk::Orientation::VERTICAL), hbox(Gtk::O
     max_scale_factor.set_digits(1);
     max_scale_factor.signal_value_changed().connect(sigc::mem_fun(*this, &SettingsWindow::max_scale_factor_changed));
 
+    vbox.append(cache_hbox);
+    cache_hbox.set_hexpand(true);
+
+    cache_hbox.append(cache_size_label);
+    cache_size_label.set_margin(5);
+
+    cache_hbox.append(cache_size);
+    cache_size.set_adjustment(cache_size_adj);
+    cache_size.set_hexpand(true);
+    cache_size.set_digits(0);
+    cache_size.set_tooltip_text("How much disk space decoded images can use, 0 turns the cache off");
+    cache_size.signal_value_changed().connect(sigc::mem_fun(*this, &SettingsWindow::cache_size_changed));
+
+    vbox.append(aspect_hbox);
+    aspect_hbox.set_hexpand(true);
+
+    aspect_hbox.append(char_aspect_label);
+    char_aspect_label.set_margin(5);
+
+    aspect_hbox.append(char_aspect);
+    char_aspect.set_adjustment(char_aspect_adj);
+    char_aspect.set_hexpand(true);
+    char_aspect.set_digits(1);
+    char_aspect.set_tooltip_text("How much taller than wide a character is, rows are scaled by this much more than columns");
+    char_aspect.signal_value_changed().connect(sigc::mem_fun(*this, &SettingsWindow::char_aspect_changed));
+
+    vbox.append(threads_hbox);
+    threads_hbox.set_hexpand(true);
+
+    threads_hbox.append(threads_label);
+    threads_label.set_margin(5);
+
+    threads_hbox.append(threads);
+    threads.set_adjustment(threads_adj);
+    threads.set_hexpand(true);
+    threads.set_digits(0);
+    threads.set_tooltip_text("How many threads a conversion is split across, defaults to one per core");
+    threads.signal_value_changed().connect(sigc::mem_fun(*this, &SettingsWindow::threads_changed));
+
+    vbox.append(filter_hbox);
+    filter_hbox.set_hexpand(true);
+
+    filter_hbox.append(filter_label);
+    filter_label.set_margin(5);
+
+    filter_hbox.append(filter_dropdown);
+    filter_dropdown.set_hexpand(true);
+    filter_dropdown.set_selected((guint)s.filter); // the entries are in the same order as Filter
+    filter_dropdown.set_tooltip_text("How pixels are combined when the image is scaled down");
+    filter_dropdown.property_selected().signal_changed().connect(sigc::mem_fun(*this, &SettingsWindow::filter_changed));
+
+    vbox.append(ramp_hbox);
+    ramp_hbox.set_hexpand(true);
+
+    ramp_hbox.append(ramp_label);
+    ramp_label.set_margin(5);
+
+    ramp_hbox.append(ramp_entry);
+    ramp_entry.set_hexpand(true);
+    ramp_entry.set_text(s.ramp);
+    ramp_entry.set_placeholder_text("Default");
+    ramp_entry.set_tooltip_text("The characters to draw with, from the least ink to the most");
+    ramp_entry.signal_changed().connect(sigc::mem_fun(*this, &SettingsWindow::ramp_changed));
+
+    vbox.append(color_hbox);
+    color_hbox.set_hexpand(true);
+
+    color_hbox.append(color_label);
+    color_label.set_margin(5);
+
+    color_hbox.append(color_dropdown);
+    color_dropdown.set_hexpand(true);
+    color_dropdown.set_selected((guint)s.color); // the entries are in the same order as ColorMode
+    color_dropdown.set_tooltip_text("Color the text with the colors of the image when it's exported, not in low memory mode");
+    color_dropdown.property_selected().signal_changed().connect(sigc::mem_fun(*this, &SettingsWindow::color_changed));
+
     vbox.append(size_limit_button);
     size_limit_button.set_active(s.size_limit);
     size_limit_button.signal_toggled().connect(sigc::mem_fun(*this, &SettingsWindow::size_limit_toggled));
@@ -59,6 +146,25 @@ SettingsWindow::SettingsWindow() : vbox(Gtk::Orientation::VERTICAL), hbox(Gtk::O
     dark_mode_button.set_active(s.dark_mode);
     dark_mode_button.signal_toggled().connect(sigc::mem_fun(*this, &SettingsWindow::dark_mode_toggled));
 
+    vbox.append(low_memory_button);
+    low_memory_button.set_active(s.low_memory);
+    low_memory_button.signal_toggled().connect(sigc::mem_fun(*this, &SettingsWindow::low_memory_toggled));
+
+    vbox.append(progressive_button);
+    progressive_button.set_active(s.progressive);
+    progressive_button.set_tooltip_text("Show a rough preview of large JPEG and binary PGM images while they decode");
+    progressive_button.signal_toggled().connect(sigc::mem_fun(*this, &SettingsWindow::progressive_toggled));
+
+    vbox.append(shapes_button);
+    shapes_button.set_active(s.shapes);
+    shapes_button.set_tooltip_text("Pick each character by the shape of the pixels it covers, not just their brightness");
+    shapes_button.signal_toggled().connect(sigc::mem_fun(*this, &SettingsWindow::shapes_toggled));
+
+    vbox.append(animate_button);
+    animate_button.set_active(s.animate);
+    animate_button.set_tooltip_text("Play animated GIF and WebP images instead of converting their first frame");
+    animate_button.signal_toggled().connect(sigc::mem_fun(*this, &SettingsWindow::animate_toggled));
+
 };
 
 SettingsWindow::~SettingsWindow() {}
@@ -76,6 +182,78 @@ void SettingsWindow::max_scale_factor_changed() {
     s.max_scale_factor = max_scale_factor.get_value();
 }
 
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the cache_size spin button
+ * is changed. It then updates the settings with
+ * the new value.
+ *
+*/
+void SettingsWindow::cache_size_changed() {
+    s.cache_size = cache_size.get_value_as_int();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the char_aspect spin button
+ * is changed. It then updates the settings with
+ * the new value.
+ *
+*/
+void SettingsWindow::char_aspect_changed() {
+    s.char_aspect = char_aspect.get_value();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the threads spin button
+ * is changed. It then updates the settings with
+ * the new value.
+ *
+*/
+void SettingsWindow::threads_changed() {
+    s.threads = threads.get_value_as_int();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when a new entry is picked in the
+ * filter_dropdown. It then updates the settings
+ * with the new value.
+ *
+*/
+void SettingsWindow::filter_changed() {
+    s.filter = (Filter)filter_dropdown.get_selected();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the text in the ramp_entry is
+ * changed. It then updates the settings with
+ * the new value.
+ *
+*/
+void SettingsWindow::ramp_changed() {
+    s.ramp = ramp_entry.get_text();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when a new entry is picked in the
+ * color_dropdown. It then updates the settings
+ * with the new value.
+ *
+*/
+void SettingsWindow::color_changed() {
+    s.color = (ColorMode)color_dropdown.get_selected();
+}
+
 /**
  * @ingroup SignalFunctions
  *
@@ -105,6 +283,50 @@ void SettingsWindow::dark_mode_toggled() {
                                         GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
 }
 
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the low_memory_button is toggled.
+ * It then updates the settings with the new value.
+ *
+*/
+void SettingsWindow::low_memory_toggled() {
+    s.low_memory = low_memory_button.get_active();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the progressive_button is toggled.
+ * It then updates the settings with the new value.
+ *
+*/
+void SettingsWindow::progressive_toggled() {
+    s.progressive = progressive_button.get_active();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the shapes_button is toggled.
+ * It then updates the settings with the new value.
+ *
+*/
+void SettingsWindow::shapes_toggled() {
+    s.shapes = shapes_button.get_active();
+}
+
+/**
+ * @ingroup SignalFunctions
+ *
+ * Runs when the animate_button is toggled.
+ * It then updates the settings with the new value.
+ *
+*/
+void SettingsWindow::animate_toggled() {
+    s.animate = animate_button.get_active();
+}
+
 /**
  * @ingroup SignalFunctions
  *
@@ -158,8 +380,9 @@ file to convert by pressing the 'Choose File' button. The current file will be d
 below the button.\n\nYou can adjust the scale factor by changing the number to the right of the file name. \
 The higher the scale factor, the smaller the image.\n\nNow, click 'Run' to start the conversion process. \
 Depending on the size of the image and the scale factor, this process may take a while. The progress bar \
-will show you how far along the process is.\n\nOnce the process is complete, you can either copy the raw text \
-to the clipboard, or export it to an RTF file. You can also clear the text if you want to start over.\n\n\
+will show you how far along the process is.\n\nScroll to move around the image, and hold control while \
+scrolling to zoom in and out.\n\nOnce the process is complete, you can either copy the raw text \
+to the clipboard, or export it to an RTF, text, HTML or ANSI file. You can also clear the text if you want to start over.\n\n\
 You can click the settings button to change the settings for the application, or click the close button to \
 go back to the main window. Enjoy!</span>");
 
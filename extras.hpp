@@ -27,9 +27,19 @@ class SettingsWindow : public Gtk::Window {
         void close_button_clicked(); ///< A function to close the settings window
         void size_limit_toggled(); ///< A function to toggle the size limit setting
         void dark_mode_toggled(); ///< A function to toggle the dark mode setting
+        void low_memory_toggled(); ///< A function to toggle the low memory setting
+        void progressive_toggled(); ///< A function to toggle the progressive preview setting
+        void shapes_toggled(); ///< A function to toggle the shape matching setting
+        void animate_toggled(); ///< A function to toggle the animation setting
         void max_scale_factor_changed(); ///< A function to change the max scale factor setting
+        void cache_size_changed(); ///< A function to change the cache size setting
+        void char_aspect_changed(); ///< A function to change the character aspect setting
+        void threads_changed(); ///< A function to change the threads setting
+        void filter_changed(); ///< A function to change the filter setting
+        void ramp_changed(); ///< A function to change the ramp setting
+        void color_changed(); ///< A function to change the color setting
 
-        Gtk::Box vbox, hbox; ///< Invisible UI box to control layout
+        Gtk::Box vbox, hbox, cache_hbox, filter_hbox, aspect_hbox, threads_hbox, ramp_hbox, color_hbox; ///< Invisible UI box to control layout
         Glib::RefPtr<Gtk::CssProvider> css_provider; ///< A CSS provider to style the help window
         
         Gtk::Button close_button; ///< A button to close the settings window
@@ -37,9 +47,28 @@ class SettingsWindow : public Gtk::Window {
 
         Gtk::CheckButton size_limit_button; ///< A button to toggle the size limit setting
         Gtk::CheckButton dark_mode_button; ///< A button to toggle the dark mode setting
+        Gtk::CheckButton low_memory_button; ///< A button to toggle the low memory setting
+        Gtk::CheckButton progressive_button; ///< A button to toggle the progressive preview setting
+        Gtk::CheckButton shapes_button; ///< A button to toggle the shape matching setting
+        Gtk::CheckButton animate_button; ///< A button to toggle the animation setting
         Gtk::Label max_scale_factor_label; ///< A label to describe the max scale factor setting
         Gtk::SpinButton max_scale_factor; ///< A button to change the max scale factor setting
         Glib::RefPtr<Gtk::Adjustment> max_scale_factor_adj; ///< The adjustment to set the settings for the max_scale_factor
+        Gtk::Label cache_size_label; ///< A label to describe the cache size setting
+        Gtk::SpinButton cache_size; ///< A button to change the cache size setting
+        Glib::RefPtr<Gtk::Adjustment> cache_size_adj; ///< The adjustment to set the settings for the cache_size
+        Gtk::Label char_aspect_label; ///< A label to describe the character aspect setting
+        Gtk::SpinButton char_aspect; ///< A button to change the character aspect setting
+        Glib::RefPtr<Gtk::Adjustment> char_aspect_adj; ///< The adjustment to set the settings for the char_aspect
+        Gtk::Label threads_label; ///< A label to describe the threads setting
+        Gtk::SpinButton threads; ///< A button to change the threads setting
+        Glib::RefPtr<Gtk::Adjustment> threads_adj; ///< The adjustment to set the settings for the threads
+        Gtk::Label filter_label; ///< A label to describe the filter setting
+        Gtk::DropDown filter_dropdown; ///< A dropdown to choose the filter setting
+        Gtk::Label ramp_label; ///< A label to describe the ramp setting
+        Gtk::Entry ramp_entry; ///< An entry to type the ramp setting into
+        Gtk::Label color_label; ///< A label to describe the color setting
+        Gtk::DropDown color_dropdown; ///< A dropdown to choose the color setting
 };
 
 // https://stackoverflow.com/questions/15441157/gtkmm-multiple-windows-popup-window
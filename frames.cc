@@ -0,0 +1,169 @@
+#include "frames.hpp"
+#include "resample.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/**
+ * @file frames.cc
+ *
+*/
+
+/// The number of decoded frames that can wait to be converted
+constexpr std::size_t frame_queue_depth = 2;
+
+/// The longest a wait for a frame to be due goes without checking whether it should stop
+constexpr std::chrono::milliseconds frame_poll(10);
+
+/**
+ * @brief Plays an animation as ASCII art
+ *
+ * Frames are decoded on a thread of their own while the calling
+ * thread converts and shows them, so frame N+1 is decoded while
+ * frame N is mapped. The decoding thread stays at most
+ * frame_queue_depth frames ahead. Each frame is shown at the time
+ * the animation says it's due. A frame that's already past the end
+ * of its time when it's taken off the queue is dropped without being
+ * converted, so a slow conversion skips frames instead of falling
+ * further and further behind. The latency of a frame is the time
+ * spent decoding and converting it, not the time it spent queued
+ * or waiting to be due. If resize is given, it's asked before each
+ * frame is converted whether the text should be a new size, like
+ * when the terminal it's shown in was resized, and the frames are
+ * scaled to that size from then on.
+ *
+ * @param[in] source the frames to play
+ * @param[in] destw the width of the text
+ * @param[in] desth the height of the text
+ * @param[in] s the settings to convert with, for the filter, ramp, shapes and dark mode
+ * @param[in] ramps the glyph tables, only used from the calling thread
+ * @param[in] fps the frames per second to play at, or 0 to use each frame's own duration
+ * @param[in] pool the threads to split each conversion across
+ * @param[in] cancel checked between frames and once per row of each conversion
+ * @param[in] show the function to show the text of each frame with, which can take the text and stop playing
+ * @param[out] stats the number of frames shown and dropped, and their latency
+ * @param[in] resize a function that can change destw and desth between frames, or nullptr to keep them
+ * @return false if it was stopped, true if the frames ran out
+ *
+*/
+bool play_frames(FrameSource &source, int destw, int desth, const Settings &s, GlyphRamps &ramps, double fps,
+                 ThreadPool &pool, const CancelToken *cancel, const FrameFunc &show, PlaybackStats &stats,
+                 const SizeFunc &resize) {
+    using Clock = std::chrono::steady_clock;
+
+    /// A decoded frame waiting to be converted
+    struct Pending {
+        LumImage frame; ///< The luminance values
+        double duration = 0.0; ///< How many seconds it's shown for
+        Clock::duration decoding; ///< How long it took to decode
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Pending> queue;
+    bool ended = false; // the source has no more frames
+    bool quit = false; // the calling thread has stopped taking frames
+
+    std::thread decoder([&] {
+        while (true) {
+            Pending pending;
+            const Clock::time_point start = Clock::now();
+            bool read = source.next(pending.frame, pending.duration);
+            pending.decoding = Clock::now() - start;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return quit || queue.size() < frame_queue_depth; });
+            if (quit || !read) {
+                ended = true;
+                changed.notify_all();
+                return;
+            }
+            queue.push_back(std::move(pending));
+            changed.notify_all();
+        }
+    });
+
+    // when matching shapes, every character needs a few pixels, not one
+    auto make_resampler = [&] {
+        const int scaledw = s.shapes ? destw * shape_columns : destw;
+        const int scaledh = s.shapes ? desth * shape_rows : desth;
+        return Resampler(source.width(), source.height(), scaledw, scaledh, s.filter);
+    };
+    Resampler resampler = make_resampler();
+    const GlyphTable &glyphs = ramps.get(s.ramp, s.dark_mode);
+    const ShapeTable no_shapes;
+    const ShapeTable &shapes = s.shapes ? ramps.shapes(s.ramp, s.dark_mode) : no_shapes;
+
+    stats = PlaybackStats();
+    double total_latency = 0.0;
+    bool finished = false;
+    Clock::time_point due; // when the next frame should be shown
+    LumImage scaled;
+    std::string text;
+
+    while (!cancelled(cancel)) {
+        Pending pending;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&] { return ended || !queue.empty(); });
+            if (queue.empty()) {
+                finished = true;
+                break;
+            }
+            pending = std::move(queue.front());
+            queue.pop_front();
+            changed.notify_all();
+        }
+
+        const Clock::time_point now = Clock::now();
+        if (stats.shown + stats.dropped == 0) {
+            due = now;
+        }
+        const double seconds = fps > 0 ? 1.0 / fps : pending.duration;
+        const Clock::time_point shown_until = due + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+
+        if (now >= shown_until) { // its time is already over
+            stats.dropped++;
+            due = shown_until;
+            continue;
+        }
+
+        const Clock::time_point start = Clock::now();
+        if (resize && resize(destw, desth)) { // the weights only depend on the sizes, so they're only worked out again when those change
+            resampler = make_resampler();
+        }
+        if (!resampler.resample(pending.frame.view(), scaled, pool, cancel)) {
+            break;
+        }
+        bool mapped = s.shapes ? map_shapes(scaled, shapes, text, pool, cancel) : map_glyphs(scaled, glyphs, text, pool, cancel);
+        if (!mapped) {
+            break;
+        }
+
+        const double latency = std::chrono::duration<double, std::milli>(pending.decoding + (Clock::now() - start)).count();
+
+        for (Clock::time_point t = Clock::now(); t < due && !cancelled(cancel); t = Clock::now()) { // a frame can be due seconds from now
+            std::this_thread::sleep_for(std::min<Clock::duration>(due - t, frame_poll));
+        }
+        if (cancelled(cancel) || !show(text)) {
+            break;
+        }
+        stats.shown++;
+        total_latency += latency;
+        stats.worst_latency = std::max(stats.worst_latency, latency);
+        due = shown_until;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    changed.notify_all();
+    decoder.join(); // the source checks cancel too, so this doesn't wait on a stream that has stalled
+
+    stats.mean_latency = stats.shown > 0 ? total_latency / stats.shown : 0.0;
+    return finished && !cancelled(cancel); // the source also stops early when it's cancelled
+}
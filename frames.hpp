@@ -0,0 +1,52 @@
+#include <functional>
+#include <string>
+#include "image.hpp"
+#include "settings.hpp"
+#include "glyphs.hpp"
+#include "threadpool.hpp"
+#include "cancel.hpp"
+
+#pragma once
+
+/**
+ * @file frames.hpp
+ *
+*/
+
+/**
+ * @brief A class that hands out the frames of an animation one at a time
+ *
+ * A base class for anything that can produce a sequence of
+ * grayscale frames of the same size, like an animated GIF or raw
+ * frames piped in from a video decoder.
+ *
+*/
+class FrameSource {
+    public:
+        virtual ~FrameSource() = default; ///< The FrameSource destructor
+
+        virtual int width() const = 0; ///< A function that returns the width of every frame
+        virtual int height() const = 0; ///< A function that returns the height of every frame
+
+        /// A function to read the next frame and how many seconds it's shown for, false if there isn't one
+        virtual bool next(LumImage &frame, double &duration) = 0;
+};
+
+/// What happened while frames were played
+struct PlaybackStats {
+    int shown = 0; ///< The number of frames that were shown
+    int dropped = 0; ///< The number of frames that were skipped because they were already late
+    double mean_latency = 0.0; ///< The average time spent decoding and converting a frame that was shown, in milliseconds
+    double worst_latency = 0.0; ///< The longest time spent decoding and converting a frame that was shown, in milliseconds
+};
+
+/// A function that shows the text of a frame, which it can move from to keep it, false to stop playing
+using FrameFunc = std::function<bool(std::string &text)>;
+
+/// A function that can change the size of the text between frames, true if it changed it
+using SizeFunc = std::function<bool(int &destw, int &desth)>;
+
+/// A function to convert frames to ASCII art and show them on time, false if it was stopped before the frames ran out
+bool play_frames(FrameSource &source, int destw, int desth, const Settings &s, GlyphRamps &ramps, double fps,
+                 ThreadPool &pool, const CancelToken *cancel, const FrameFunc &show, PlaybackStats &stats,
+                 const SizeFunc &resize = nullptr);
@@ -0,0 +1,380 @@
+#include "glyphs.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @file glyphs.cc
+ *
+*/
+
+/// The number of samples in one character when matching shapes
+constexpr int shape_samples = shape_columns * shape_rows;
+
+/**
+ * How much of each part of every printable ASCII character is ink,
+ * from 0 (none) to 255 (all of it), in DejaVu Sans Mono. Each
+ * character's cell, its advance by its ascent plus descent, is split
+ * into shape_columns by shape_rows parts, listed a row at a time
+ * from the top left.
+*/
+static const unsigned char glyph_coverage['~' - ' ' + 1][shape_samples] = {
+    {  0,   0,   0,   0,   0,   0,   0,   0}, // ' '
+    { 14,  14,  42,  42,  23,  24,   9,   9}, // '!'
+    { 25,  25,  46,  46,   0,   0,   0,   0}, // '"'
+    { 14,  25, 100, 114, 114,  99,  17,  10}, // '#'
+    {  5,  14, 104,  69,  46, 128,  30,  38}, // '$'
+    { 31,   0, 112,  48,  45, 114,   0,  27}, // '%'
+    { 38,  30, 100,   9,  93, 137,  32,  38}, // '&'
+    { 11,  11,  20,  20,   0,   0,   0,   0}, // "'"
+    {  0,  28,  54,  23,  65,  12,   6,  38}, // '('
+    { 28,   0,  23,  54,  12,  65,  39,   6}, // ')'
+    {  9,   9,  82,  82,   4,   4,   0,   0}, // '*'
+    {  0,   0,  33,  33,  80,  80,   0,   0}, // '+'
+    {  0,   0,   0,   0,  14,  18,  42,  13}, // ','
+    {  0,   0,   0,   0,  27,  27,   0,   0}, // '-'
+    {  0,   0,   0,   0,  18,  18,  11,  11}, // '.'
+    {  0,  27,   7,  71,  72,   7,  40,   0}, // '/'
+    { 36,  36,  98,  98,  95,  95,  23,  23}, // '0'
+    { 39,  25,  18,  74,  21,  85,  29,  42}, // '1'
+    { 53,  38,   5,  89,  75,  40,  40,  38}, // '2'
+    { 51,  38,  29,  95,  19,  98,  41,  23}, // '3'
+    {  0,  38,  59,  82,  77, 109,   0,  15}, // '4'
+    { 53,  40,  92,  48,  16,  94,  42,  19}, // '5'
+    { 33,  46, 112,  52,  93,  90,  22,  27}, // '6'
+    { 59,  58,   0,  81,  49,  36,  18,   0}, // '7'
+    { 42,  42,  93,  93,  93,  94,  27,  27}, // '8'
+    { 42,  36,  86,  93,  53, 112,  35,  17}, // '9'
+    {  0,   0,  27,  27,  18,  18,  11,  11}, // ':'
+    {  0,   0,  27,  27,  14,  18,  42,  13}, // ';'
+    {  0,   0,  42,  66,  70,  66,   0,   0}, // '<'
+    {  0,   0,  65,  65,  65,  65,   0,   0}, // '='
+    {  0,   0,  66,  42,  66,  70,   0,   0}, // '>'
+    { 41,  41,  10,  85,  39,  24,  11,   7}, // '?'
+    {  9,  19,  97, 123, 117, 107,  57,  40}, // '@'
+    { 21,  21,  77,  77, 111, 111,  18,  18}, // 'A'
+    { 59,  39, 116, 104,  94, 100,  40,  22}, // 'B'
+    { 29,  54,  90,   3,  93,  18,  15,  39}, // 'C'
+    { 61,  25,  85,  91,  96,  95,  40,  10}, // 'D'
+    { 53,  56, 110,  53,  92,  17,  35,  42}, // 'E'
+    { 50,  59, 107,  53,  85,   0,  18,   0}, // 'F'
+    { 33,  49,  88,  19,  93, 106,  18,  36}, // 'G'
+    { 28,  28, 119, 119,  85,  85,  18,  18}, // 'H'
+    { 51,  51,  42,  42,  53,  53,  35,  35}, // 'I'
+    { 28,  44,   0,  85,  23,  88,  42,  15}, // 'J'
+    { 28,  32, 135,  59,  96,  92,  18,  21}, // 'K'
+    { 28,   0,  85,   0,  92,  18,  35,  44}, // 'L'
+    { 43,  43, 143, 145,  98,  97,  18,  18}, // 'M'
+    { 42,  28, 146,  94,  89, 147,  18,  25}, // 'N'
+    { 39,  39,  86,  86,  90,  91,  24,  24}, // 'O'
+    { 53,  44,  92, 104,  99,  21,  18,   0}, // 'P'
+    { 39,  39,  86,  86,  90,  91,  24,  60}, // 'Q'
+    { 59,  35,  94,  97,  89,  90,  15,  18}, // 'R'
+    { 41,  45, 104,  28,  24, 103,  37,  27}, // 'S'
+    { 70,  70,  42,  42,  42,  42,   9,   9}, // 'T'
+    { 28,  28,  85,  85,  90,  90,  26,  26}, // 'U'
+    { 28,  28,  81,  81,  73,  73,  12,  12}, // 'V'
+    { 27,  27, 112, 111, 122, 121,  18,  18}, // 'W'
+    { 30,  29,  74,  77,  85,  84,  19,  18}, // 'X'
+    { 30,  30,  81,  81,  43,  43,   9,   9}, // 'Y'
+    { 53,  69,   5,  84,  87,  26,  40,  49}, // 'Z'
+    { 27,  31,  64,  11,  64,  11,  40,  29}, // '['
+    { 27,   0,  77,   1,  16,  62,   0,  40}, // '\\'
+    { 31,  27,  11,  64,  11,  64,  29,  40}, // ']'
+    { 22,  22,  52,  52,   0,   0,   0,   0}, // '^'
+    {  0,   0,   0,   0,   0,   0,  32,  32}, // '_'
+    { 35,   5,   1,   4,   0,   0,   0,   0}, // '`'
+    {  0,   0,  48,  67,  98, 120,  33,  28}, // 'a'
+    { 31,   0, 102,  73,  89,  84,  30,  28}, // 'b'
+    {  0,   0,  61,  50,  84,  13,  15,  37}, // 'c'
+    {  0,  35,  73, 113,  85,  99,  27,  32}, // 'd'
+    {  0,   0,  67,  71, 116,  74,  21,  37}, // 'e'
+    { 10,  50,  82,  62,  53,  21,  11,   4}, // 'f'
+    {  0,   0,  74,  83,  86, 100,  62,  89}, // 'g'
+    { 31,   0,  99,  73,  74,  74,  15,  15}, // 'h'
+    { 12,  16,  52,  30,  38,  49,  38,  42}, // 'i'
+    {  4,  28,  39,  53,  11,  74,  60,  48}, // 'j'
+    { 35,   0,  92,  61, 108,  80,  18,  19}, // 'k'
+    { 61,   5,  64,  11,  60,  28,   2,  32}, // 'l'
+    {  0,   0, 104,  93, 106,  96,  22,  20}, // 'm'
+    {  0,   0,  77,  73,  74,  74,  15,  15}, // 'n'
+    {  0,   0,  71,  70,  87,  87,  24,  24}, // 'o'
+    {  0,   0,  89,  73,  99,  86,  92,  27}, // 'p'
+    {  0,   0,  70,  81,  85,  91,  27,  84}, // 'q'
+    {  0,   0,  63,  66,  75,   0,  15,   0}, // 'r'
+    {  0,   0,  68,  42,  53,  90,  34,  24}, // 's'
+    { 15,   0, 106,  42,  72,  13,   5,  33}, // 't'
+    {  0,   0,  50,  50,  81,  90,  29,  28}, // 'u'
+    {  0,   0,  55,  55,  75,  75,  12,  12}, // 'v'
+    {  0,   0,  58,  58, 120, 120,  17,  17}, // 'w'
+    {  0,   0,  59,  59,  75,  75,  18,  18}, // 'x'
+    {  0,   0,  57,  56,  73,  75,  74,  19}, // 'y'
+    {  0,   0,  40,  82,  67,  30,  35,  35}, // 'z'
+    {  7,  46,  37,  40,  71,  29,  17,  60}, // '{'
+    { 13,  13,  32,  32,  32,  32,  32,  32}, // '|'
+    { 46,   6,  40,  36,  29,  70,  60,  16}, // '}'
+    {  0,   0,  16,   4,  46,  60,   0,   0}, // '~'
+};
+
+/**
+ * @brief Finds the closest character of a ramp to every pattern of samples
+ *
+ * Every sample of a cell is quantized to 2 bits, so all the patterns
+ * a cell can have fit in a table of 65536 characters, and matching a
+ * cell is one lookup. Each pattern gets the character whose ink is
+ * closest to it, by the sum of squared differences, with the ink of
+ * the ramp scaled so its densest part is 255. The sum is split in two
+ * halves of 4 samples each, so every half is only worked out once
+ * for each of its 256 patterns.
+ *
+ * @param[in] ramp the characters to choose from, characters that aren't printable ASCII are skipped
+ * @param[in] dark_mode whether the text will be shown light on dark, so ink is light
+ * @return the table, indexed by the patterns match_shapes() makes
+ *
+*/
+ShapeTable make_shape_table(std::string_view ramp, bool dark_mode) {
+    std::string glyphs;
+    for (char c : ramp) {
+        if (c >= ' ' && c <= '~' && glyphs.find(c) == std::string::npos) {
+            glyphs += c;
+        }
+    }
+    if (glyphs.empty()) {
+        glyphs = " ";
+    }
+    const int count = glyphs.size();
+
+    int most = 1;
+    for (char c : glyphs) {
+        for (int i = 0; i < shape_samples; i++) {
+            most = std::max<int>(most, glyph_coverage[c - ' '][i]);
+        }
+    }
+
+    constexpr int half = shape_samples / 2; // the samples in each half of a pattern
+    std::vector<int> distance(2 * 256 * count); // for each half, each of its patterns and each character
+    for (int g = 0; g < count; g++) {
+        const unsigned char *coverage = glyph_coverage[glyphs[g] - ' '];
+        for (int h = 0; h < 2; h++) {
+            for (int pattern = 0; pattern < 256; pattern++) {
+                int sum = 0;
+                for (int i = 0; i < half; i++) {
+                    int lum = ((pattern >> (2 * i)) & 3) * 85; // so black and white stay exactly black and white
+                    int ink = dark_mode ? lum : 255 - lum;
+                    int diff = ink - coverage[h * half + i] * 255 / most;
+                    sum += diff * diff;
+                }
+                distance[(h * 256 + pattern) * count + g] = sum;
+            }
+        }
+    }
+
+    ShapeTable table(1 << (2 * shape_samples));
+    for (int code = 0; code < (int)table.size(); code++) {
+        const int *low = distance.data() + (code & 0xFF) * count;
+        const int *high = distance.data() + (256 + (code >> 8)) * count;
+        int best = 0;
+        int best_sum = INT_MAX;
+        for (int g = 0; g < count; g++) {
+            if (low[g] + high[g] < best_sum) {
+                best_sum = low[g] + high[g];
+                best = g;
+            }
+        }
+        table[code] = glyphs[best];
+    }
+
+    return table;
+}
+
+/**
+ * @brief Turns a row of cells into characters by their shape
+ *
+ * Each cell is shape_columns samples across and shape_rows samples
+ * down. Its samples are quantized to 2 bits and packed into a
+ * pattern, a row at a time from the top left, which is looked up in
+ * a table made by make_shape_table(). Eight cells are packed at once
+ * with SSE2. Up to 16 bytes past the end of each row may be read,
+ * which LumImage rows always allow.
+ *
+ * @param[in] rows the shape_rows rows of samples, cells * shape_columns long
+ * @param[in] cells the number of cells in the row
+ * @param[in] table the character for every pattern
+ * @param[out] out the characters, cells long
+ *
+*/
+void match_shapes(const unsigned char *const *rows, int cells, const ShapeTable &table, char *out) {
+    int c = 0;
+
+#if defined(__SSE2__)
+    const __m128i low_mask = _mm_set1_epi16(0x3);
+    const __m128i high_mask = _mm_set1_epi16(0xC);
+    alignas(16) std::uint16_t codes[8];
+
+    for (; c + 8 <= cells; c += 8) {
+        __m128i code = _mm_setzero_si128();
+        for (int r = 0; r < shape_rows; r++) {
+            // each 16 bit lane is a cell, its left sample in the low byte and its right sample in the high byte
+            __m128i samples = _mm_loadu_si128((const __m128i *)(rows[r] + c * shape_columns));
+            __m128i left = _mm_and_si128(_mm_srli_epi16(samples, 6), low_mask);
+            __m128i right = _mm_and_si128(_mm_srli_epi16(samples, 12), high_mask);
+            code = _mm_or_si128(code, _mm_slli_epi16(_mm_or_si128(left, right), 4 * r));
+        }
+        _mm_store_si128((__m128i *)codes, code);
+        for (int i = 0; i < 8; i++) {
+            out[c + i] = table[codes[i]];
+        }
+    }
+#endif
+
+    for (; c < cells; c++) {
+        int code = 0;
+        for (int r = 0; r < shape_rows; r++) {
+            for (int x = 0; x < shape_columns; x++) {
+                code |= (rows[r][c * shape_columns + x] >> 6) << (2 * (r * shape_columns + x));
+            }
+        }
+        out[c] = table[code];
+    }
+}
+
+/**
+ * @brief Turns a scaled image into ASCII art
+ *
+ * Maps every pixel to a character, in bands of rows on pool,
+ * straight into text. Every row of text ends in a newline.
+ *
+ * @param[in] scaled the image, scaled to one pixel per character
+ * @param[in] glyphs the character for every luminance value
+ * @param[out] text the ASCII art
+ * @param[in] pool the threads to map the bands on
+ * @param[in] cancel checked once per row
+ * @return false if it was cancelled, in which case text is incomplete
+ *
+*/
+bool map_glyphs(const LumImage &scaled, const GlyphTable &glyphs, std::string &text, ThreadPool &pool,
+                const CancelToken *cancel) {
+    const int destw = scaled.width();
+    const int desth = scaled.height();
+    text.assign((std::size_t)(destw+1) * desth, '\n'); // exactly the art, so it's written once and never resized
+
+    int bands = band_count(pool, desth, 16);
+    pool.run(bands, [&](int band) { // each band of rows has its own place in text
+        for (int h = band_begin(desth, bands, band); h < band_begin(desth, bands, band + 1) && !cancelled(cancel); h++) {
+            const unsigned char *row = scaled.row(h);
+            char *out = text.data() + (std::size_t)h * (destw+1);
+            for (int w = 0; w < destw; w++) {
+                out[w] = glyphs[row[w]];
+            }
+        }
+    });
+
+    return !cancelled(cancel);
+}
+
+/**
+ * @brief Turns a scaled image into ASCII art by shape
+ *
+ * Like map_glyphs(), but each character covers shape_columns by
+ * shape_rows pixels, and it's picked by matching the pattern they
+ * make with match_shapes(), not just by their brightness.
+ *
+ * @param[in] scaled the image, scaled to shape_columns by shape_rows pixels per character
+ * @param[in] shapes the character for every pattern
+ * @param[out] text the ASCII art
+ * @param[in] pool the threads to map the bands on
+ * @param[in] cancel checked once per row
+ * @return false if it was cancelled, in which case text is incomplete
+ *
+*/
+bool map_shapes(const LumImage &scaled, const ShapeTable &shapes, std::string &text, ThreadPool &pool,
+                const CancelToken *cancel) {
+    const int destw = scaled.width() / shape_columns;
+    const int desth = scaled.height() / shape_rows;
+    text.assign((std::size_t)(destw+1) * desth, '\n'); // exactly the art, so it's written once and never resized
+
+    int bands = band_count(pool, desth, 16);
+    pool.run(bands, [&](int band) {
+        const unsigned char *rows[shape_rows];
+        for (int h = band_begin(desth, bands, band); h < band_begin(desth, bands, band + 1) && !cancelled(cancel); h++) {
+            for (int r = 0; r < shape_rows; r++) {
+                rows[r] = scaled.row(h * shape_rows + r);
+            }
+            match_shapes(rows, destw, shapes, text.data() + (std::size_t)h * (destw+1));
+        }
+    });
+
+    return !cancelled(cancel);
+}
+
+/**
+ * Switches to a ramp if it isn't the last one, keeping only
+ * its printable ASCII characters. The tables for the last ramp
+ * are dropped.
+ *
+ * @param[in] ramp the characters, from the least ink to the most, or empty for default_ramp
+ *
+*/
+void GlyphRamps::use(const std::string &ramp) {
+    if (ramp == last_ramp) {
+        return;
+    }
+    last_ramp = ramp;
+
+    chars.clear();
+    for (char c : ramp) {
+        if (c >= ' ' && c <= '~') {
+            chars += c;
+        }
+    }
+    custom = !chars.empty();
+    if (custom) {
+        dark = expand_ramp(chars, true);
+        light = expand_ramp(chars, false);
+    } else {
+        chars = default_ramp;
+    }
+    dark_shapes.clear();
+    light_shapes.clear();
+}
+
+/**
+ * Returns the table for a ramp. Only printable ASCII
+ * characters of the ramp are used, and if there aren't
+ * any, default_ramp is used instead.
+ *
+ * @param[in] ramp the characters, from the least ink to the most, or empty for default_ramp
+ * @param[in] dark_mode whether the text will be shown light on dark
+ * @return the table, which stays valid until the next call with a different ramp
+ *
+*/
+const GlyphTable &GlyphRamps::get(const std::string &ramp, bool dark_mode) {
+    use(ramp);
+    if (!custom) {
+        return dark_mode ? dark_glyphs : light_glyphs;
+    }
+    return dark_mode ? dark : light;
+}
+
+/**
+ * Returns the shape table for a ramp, building it the first
+ * time it's asked for. The order of the ramp doesn't matter
+ * here, only which characters are in it.
+ *
+ * @param[in] ramp the characters to choose from, or empty for default_ramp
+ * @param[in] dark_mode whether the text will be shown light on dark
+ * @return the table, which stays valid until the next call with a different ramp
+ *
+*/
+const ShapeTable &GlyphRamps::shapes(const std::string &ramp, bool dark_mode) {
+    use(ramp);
+    ShapeTable &table = dark_mode ? dark_shapes : light_shapes;
+    if (table.empty()) {
+        table = make_shape_table(chars, dark_mode);
+    }
+    return table;
+}
@@ -0,0 +1,96 @@
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "image.hpp"
+#include "threadpool.hpp"
+#include "cancel.hpp"
+
+#pragma once
+
+/**
+ * @file glyphs.hpp
+ *
+*/
+
+/// A table with a character for every luminance value, from 0 to 255
+using GlyphTable = std::array<char, 256>;
+
+/// The characters ASCII art is made of, from the least ink to the most
+constexpr std::string_view default_ramp = " `.':_,^=;><+!rc*/z?sLTv)J7|Fi{C}fI31tlu[neoZ5Yxjya2EwkP6h9d4VOGbUAKXHm8RD#$Bg0MNWQ%&@";
+// from stackoverflow (https://stackoverflow.com/questions/30097953/ascii-art-sorting-an-array-of-ascii-characters-by-brightness-levels-c-c)
+
+/**
+ * @brief Spreads a ramp of characters over every luminance value
+ *
+ * Gives each character of the ramp an equal share of the 256
+ * luminance values, as near as they divide. In dark mode the
+ * text is light on dark, so the darkest pixels get the first
+ * character of the ramp, otherwise they get the last.
+ *
+ * @param[in] ramp the characters, from the least ink to the most, not empty
+ * @param[in] dark_mode whether the text will be shown light on dark
+ * @return the character for every luminance value
+ *
+*/
+constexpr GlyphTable expand_ramp(std::string_view ramp, bool dark_mode) {
+    GlyphTable table{};
+    const std::size_t count = ramp.size();
+    for (std::size_t i = 0; i < table.size(); i++) {
+        const std::size_t j = i * count / table.size();
+        table[i] = ramp[dark_mode ? j : count - 1 - j];
+    }
+    return table;
+}
+
+constexpr GlyphTable dark_glyphs = expand_ramp(default_ramp, true); ///< default_ramp for dark mode
+constexpr GlyphTable light_glyphs = expand_ramp(default_ramp, false); ///< default_ramp for light mode
+
+/// The number of samples across a character when matching shapes
+constexpr int shape_columns = 2;
+/// The number of samples down a character when matching shapes
+constexpr int shape_rows = 4;
+
+/// A table with a character for every pattern of shape_columns by shape_rows samples, each quantized to 2 bits
+using ShapeTable = std::vector<char>;
+
+/// A function to find the closest character of a ramp to every pattern of samples
+ShapeTable make_shape_table(std::string_view ramp, bool dark_mode);
+/// A function to turn cells of shape_columns by shape_rows samples into characters
+void match_shapes(const unsigned char *const *rows, int cells, const ShapeTable &table, char *out);
+
+/// A function to turn an image scaled to one pixel per character into ASCII art, false if it was cancelled
+bool map_glyphs(const LumImage &scaled, const GlyphTable &glyphs, std::string &text, ThreadPool &pool,
+                const CancelToken *cancel = nullptr);
+/// A function to turn an image scaled to shape_columns by shape_rows pixels per character into ASCII art, false if it was cancelled
+bool map_shapes(const LumImage &scaled, const ShapeTable &shapes, std::string &text, ThreadPool &pool,
+                const CancelToken *cancel = nullptr);
+
+/**
+ * @brief A class that expands ramps and keeps them
+ *
+ * A class that hands out the tables for a ramp, using the ones
+ * built at compile time for default_ramp and expanding any other
+ * ramp only the first time it's asked for, in both polarities.
+ * The shape tables are only built when they're first needed.
+ *
+*/
+class GlyphRamps {
+    public:
+        /// A function that returns the table of characters by luminance for a ramp
+        const GlyphTable &get(const std::string &ramp, bool dark_mode);
+        /// A function that returns the table of characters by shape for a ramp
+        const ShapeTable &shapes(const std::string &ramp, bool dark_mode);
+
+    private:
+        void use(const std::string &ramp); ///< A function to switch to a ramp, dropping the tables for the last one
+
+        std::string last_ramp; ///< The last ramp asked for
+        std::string chars{default_ramp}; ///< The characters of GlyphRamps::last_ramp that can be used, or default_ramp
+        bool custom = false; ///< Whether GlyphRamps::last_ramp had any characters to use
+        GlyphTable dark{}; ///< GlyphRamps::last_ramp for dark mode
+        GlyphTable light{}; ///< GlyphRamps::last_ramp for light mode
+        ShapeTable dark_shapes; ///< The shape table for dark mode, empty until it's needed
+        ShapeTable light_shapes; ///< The shape table for light mode, empty until it's needed
+};
@@ -1,9 +1,8 @@
 #include "gui.hpp"
 #include <algorithm>
 #include <cstddef>
-#include <fstream>
+#include <cstdio>
 #include <iostream>
-#include <sstream>
 #include "settings.hpp"
 
 // Most code came from https://gnome.pages.gitlab.gnome.org/gtkmm-documentation/index.html
@@ -20,18 +19,6 @@
  *
 */
 
-/// An rtf file header with the correct settings for an ASCII art image
-const std::string rtf_header = R"({\rtf1\ansi\ansicpg1252\cocoartf2761
-\cocoatextscaling0\cocoaplatform0{\fonttbl\f0\fnil\fcharset0 Menlo-Regular;}
-{\colortbl;\red255\green255\blue255;}
-{\*\expandedcolortbl;;}
-\margl1440\margr1440\vieww17700\viewh9340\viewkind0
-\deftab720
-\pard\tx720\tx1440\tx2160\tx2880\tx3600\tx4320\tx5040\tx5760\tx6480\tx7200\tx7920\tx8640\pardeftab720\sl144\slmult1\pardirnatural\partightenfactor0
-
-\f0\fs2 \cf0 )";
-// I got the header myself, not from another source.
-
 /**
  *
  * The GUI class constructor that initializes
@@ -42,7 +29,7 @@ GUI::GUI() : vbox(Gtk::Orientation::VERTICAL), hbox1(Gtk::Orientation::HORIZONTA
                     hbox2(Gtk::Orientation::HORIZONTAL, 5), hbox3(Gtk::Orientation::HORIZONTAL),
                     choose_file_button("Choose File"), run_button("Run"), currentfile("No file selected"),
                     scale_factor_adj(Gtk::Adjustment::create(1.0, 1.0, 10.0, 0.5, 3.0, 0.0)),
-                    dispatcher(), worker(), worker_thread(nullptr), copy_button("Copy Text"), export_file_button("Export as RTF"),
+                    dispatcher(), worker(), latest_job(0), shown_revision(0), shown_playback(0), copy_button("Copy Text"), export_file_button("Export"),
                     clear_button("Clear"), help_button("Help") {
     
     set_title("ASCII Art");
@@ -90,6 +77,7 @@ GUI::GUI() : vbox(Gtk::Orientation::VERTICAL), hbox1(Gtk::Orientation::HORIZONTA
     progressbar.set_hexpand(true);
     progressbar.set_pulse_step(0.007);
     dispatcher.connect(sigc::mem_fun(*this, &GUI::on_notification));
+    export_dispatcher.connect(sigc::mem_fun(*this, &GUI::on_export_notification));
 
     hbox2.append(clear_button);
     clear_button.set_margin(5);
@@ -105,19 +93,25 @@ GUI::GUI() : vbox(Gtk::Orientation::VERTICAL), hbox1(Gtk::Orientation::HORIZONTA
     hbox3.append(export_file_button);
     export_file_button.set_margin(5);
     export_file_button.set_hexpand(true);
-    export_file_button.set_tooltip_text("Export the ASCII art as an RTF file");
+    export_file_button.set_tooltip_text("Export the ASCII art as an RTF, text, HTML or ANSI file");
     export_file_button.signal_clicked().connect(sigc::mem_fun(*this, &GUI::on_export_button_clicked));
 
     vbox.append(textout);
     textout.set_expand(true);
     textout.set_margin(10);
 
+    vbox.append(artview);
+    artview.set_expand(true);
+    artview.set_margin(10);
+    artview.set_visible(false);
+
     vbox.append(help_button);
     help_button.set_margin(5);
     help_button.set_hexpand(true);
     help_button.signal_clicked().connect(sigc::mem_fun(*this, &GUI::help_button_clicked));
     help_window = 0;
 
+    worker.start(this);
     update_buttons();
 }
 
@@ -188,11 +182,14 @@ void GUI::on_choose_file_button_finished(const Glib::RefPtr<Gio::AsyncResult>& r
  * @ingroup SignalFunctions
  *
  * Run when the GUI::clear_button is clicked and clears the
- * text in GUI::textout.
+ * text in GUI::textout and GUI::artview.
  *
 */
 void GUI::clear_button_clicked() {
     textout.set_text(" ");
+    textout.set_visible(true);
+    artview.clear();
+    artview.set_visible(false);
     set_default_size(500, 300);
 }
 
@@ -200,24 +197,28 @@ void GUI::clear_button_clicked() {
  * @ingroup SignalFunctions
  *
  * Sets the value of GUI::sfactor to the current
- * value of GUI::scale_factor.
+ * value of GUI::scale_factor. If an image has already
+ * been converted, it's converted again at the new scale.
  *
 */
 void GUI::scale_factor_changed() {
     sfactor = scale_factor.get_value();
+    if (latest_job != 0) {
+        run_button_clicked();
+    }
 }
 
 /**
  * @ingroup SignalFunctions
  *
- * Copies text from GUI::textout to the clipboard
- * if the first character isn't '-' (a minus sign)
+ * Copies the text in GUI::artview to the clipboard
+ * if it's showing art and not a message
  *
 */
 void GUI::copy_button_clicked() {
     auto clipboard = Gtk::Widget::get_clipboard();
-    if (textout.get_text()[0] != '-') {
-        clipboard->set_text(textout.get_text());
+    if (artview.get_visible()) {
+        clipboard->set_text(artview.get_text());
     }
 }
 
@@ -268,31 +269,34 @@ void GUI::on_help_window_close() {
 }
 
 /**
- * Takes some text and puts backslashes before
- * newlines or braces, so that it can be put
- * directly into an RTF file.
+ * Picks the format art is exported in when the file
+ * name doesn't say, which is the format it was colored
+ * for, or RTF if it wasn't colored.
  *
- * @param[in] text Some text to make RTF compatible
- * @return The original made RTF compatible
+ * @param[in] mode how the art is colored
+ * @return the format
  *
 */
-std::string GUI::to_rtf(std::string text) {
-    std::string out;
-    for (char c : text) {
-        if (c == '\n' || c == '}' || c == '{') {
-            out += "\\";
-        }
-        out += c;
+static ExportFormat default_format(ColorMode mode) {
+    switch (mode) {
+        case ColorMode::none:
+            return ExportFormat::rtf;
+        case ColorMode::html:
+            return ExportFormat::html;
+        case ColorMode::ansi24:
+        case ColorMode::ansi256:
+            break;
     }
-
-    return out;
+    return ExportFormat::ansi;
 }
 
 /**
  * @ingroup SignalFunctions
  *
- * Creates a save file dialog with a filter
- * for RTF files.
+ * Creates a save file dialog with filters for
+ * RTF, text, HTML and ANSI files. The filter and
+ * file name it starts with are for the format the
+ * ASCII art was colored for, or RTF if it wasn't.
  *
 */
 void GUI::on_export_button_clicked() {
@@ -300,10 +304,33 @@ void GUI::on_export_button_clicked() {
 
     auto filters = Gio::ListStore<Gtk::FileFilter>::create();
 
-    auto filter_text = Gtk::FileFilter::create();
-    filter_text->set_name("Rich Text Format files");
-    filter_text->add_mime_type("text/rtf");
-    filters->append(filter_text);
+    /// A format in the dialog
+    struct Choice {
+        ExportFormat format; ///< The format
+        const char *name; ///< The name of its filter
+        const char *pattern; ///< The files its filter shows
+        const char *initial_name; ///< The file name the dialog starts with when it's the default
+    };
+    static const Choice choices[] = {
+        {ExportFormat::rtf, "Rich Text Format files", "*.rtf", "ascii.rtf"},
+        {ExportFormat::text, "Text files", "*.txt", "ascii.txt"},
+        {ExportFormat::html, "HTML files", "*.html", "ascii.html"},
+        {ExportFormat::ansi, "Text files with ANSI colors", "*.ans", "ascii.ans"},
+    };
+
+    ColorMode mode;
+    worker.get_colored_data(nullptr, &mode);
+    const ExportFormat format = default_format(mode);
+    for (const Choice &choice : choices) {
+        auto filter = Gtk::FileFilter::create();
+        filter->set_name(choice.name);
+        filter->add_pattern(choice.pattern);
+        filters->append(filter);
+        if (choice.format == format) {
+            dialog->set_default_filter(filter);
+            dialog->set_initial_name(choice.initial_name);
+        }
+    }
 
     dialog->set_filters(filters);
 
@@ -315,8 +342,11 @@ void GUI::on_export_button_clicked() {
  * @ingroup SignalFunctions
  *
  * Run when the file export dialog created by GUI::on_export_button_clicked()
- * is closed saves the text in GUI::textout to an rtf file. The text is converted
- * to rtf format by GUI::to_rtf().
+ * is closed and starts saving the art on the GUI::exporter's thread, so the
+ * window never freezes, even for huge art. The format comes from the file's
+ * extension. The art is streamed from the buffer the worker made, without
+ * copying it. Colored text that's already in the format, HTML or ANSI
+ * escapes, is saved as it is.
  *
  * @param[in] result a Glib RefPtr to an AsyncResult passed by const reference
  * @param[in] dialog a Glib RefPtr to the original file dialog that was opened
@@ -327,10 +357,25 @@ void GUI::on_export_button_finished(const Glib::RefPtr<Gio::AsyncResult>& result
         auto file = dialog->save_finish(result);
 
         auto filepath = file->get_path();
-        
-        std::ofstream outtext(filepath, std::fstream::out | std::fstream::trunc);
-        outtext << rtf_header << to_rtf(textout.get_text()) << "}" << std::endl;
-        outtext.close();
+
+        ArtBuffer art, colored;
+        ArtStatus status;
+        ColorMode mode;
+        if (!worker.get_final_data(&art, &status, nullptr, nullptr) || status != ArtStatus::art) {
+            return;
+        }
+        worker.get_colored_data(&colored, &mode);
+
+        ExportFormat format = export_format(filepath, default_format(mode));
+        if (colored && format == default_format(mode)) { // the colored text is already HTML or has ANSI escapes
+            art = std::move(colored);
+            format = ExportFormat::text;
+        }
+
+        if (!exporter.start(std::move(art), make_exporter(format), filepath, [this] { export_dispatcher.emit(); })) {
+            std::cout << "Error: an export is already running" << std::endl;
+        }
+        update_buttons();
     } catch (const Gtk::DialogError& err) {
         //std::cout << "No file selected" << std::endl;
     } catch (const Glib::Error& err) {
@@ -339,45 +384,44 @@ void GUI::on_export_button_finished(const Glib::RefPtr<Gio::AsyncResult>& result
 }
 
 /**
- * If the GUI::worker_thread is running, disable
- * the GUI::run_button, GUI::copy_button, and
- * GUI::export_file_button buttons so sneaky users
- * can't break my stuff.
+ * If the GUI::worker has a job running, disable
+ * the GUI::copy_button and GUI::export_file_button
+ * buttons so sneaky users can't break my stuff. A job
+ * playing an animation never stops, but the frame on
+ * screen is finished, so they stay on for that. The
+ * GUI::export_file_button also stays off while the
+ * GUI::exporter is saving. The GUI::run_button stays
+ * on, because a new job just replaces the running one.
  *
 */
 void GUI::update_buttons() {
-    const bool thread_is_running = worker_thread != nullptr;
+    const bool job_is_running = !worker.has_stopped() && !worker.is_playing();
 
-    run_button.set_sensitive(!thread_is_running);
-    copy_button.set_sensitive(!thread_is_running);
-    export_file_button.set_sensitive(!thread_is_running);
+    copy_button.set_sensitive(!job_is_running);
+    export_file_button.set_sensitive(!job_is_running && !exporter.running());
 }
 
 /**
  * Sets the fraction done of the GUI::progressbar by getting
- * the fraction from GUI::worker.
+ * the fraction from GUI::worker, or makes it bounce back and
+ * forth if the image is still loading. The worker never touches
+ * the progressbar itself, because widgets belong to the main thread.
  *
 */
 void GUI::update_progress() {
     double donefrac;
-    worker.get_working_data(&donefrac);
+    bool loading;
+    worker.get_working_data(&donefrac, &loading);
 
-    if (donefrac < 1.0) {
+    if (loading) {
+        progressbar.pulse();
+    } else if (donefrac < 1.0) {
         progressbar.set_fraction(donefrac);
     } else {
         progressbar.set_fraction(1.0);
     }
 }
 
-/**
- * Calls 'pulse' on the GUI::progressbar to make a
- * bar bounce back and forth.
- *
-*/
-void GUI::pulse_pbar() {
-    progressbar.pulse();
-}
-
 
 /**
  * @ingroup SignalFunctions
@@ -390,59 +434,129 @@ void GUI::notify() {
     dispatcher.emit();
 }
 
+/**
+ * Picks the message to show when a job couldn't make any art.
+ *
+ * @param[in] status why the job failed
+ * @return the message, as Pango markup
+ *
+*/
+static const char *status_message(ArtStatus status) {
+    switch (status) {
+        case ArtStatus::no_file:
+            return "Please select an image";
+        case ArtStatus::unreadable:
+            return "Could not read the image.";
+        case ArtStatus::too_large:
+            return "Image is too large to be displayed on the screen\nTry increasing the scale factor.";
+        case ArtStatus::bad_scale:
+            return "Invalid scale factor.";
+        case ArtStatus::art:
+            break;
+    }
+    return "";
+}
+
+/**
+ * Describes what happened while an animation played.
+ *
+ * @param[in] stats the frames it showed and dropped, and how long they took
+ * @return the text for the GUI::progressbar
+ *
+*/
+static std::string playback_message(const PlaybackStats &stats) {
+    char message[128];
+    std::snprintf(message, sizeof message, "Played %d frames, dropped %d, %.1f ms per frame on average, %.1f ms at worst",
+                  stats.shown, stats.dropped, stats.mean_latency, stats.worst_latency);
+    return message;
+}
+
 /**
  * Called when GUI::dispatcher's emit() function is called and updates
- * the UI by calling GUI::update_progress(). If the GUI::worker is
- * finished, the GUI::worker_thread is joined and text is displayed
+ * the UI by calling GUI::update_progress(). If the latest job has
+ * made new art, a preview or the finished art, it's displayed.
+ * Messages go in GUI::textout and art goes in GUI::artview, which
+ * shares the buffer the job made instead of copying it and only ever
+ * draws the part that's on the screen, so even huge art shows up
+ * straight away. Results of older jobs never arrive, because a newer
+ * job stops them. When an animation stops playing, because it ended
+ * or was replaced, what happened while it played is written on the
+ * GUI::progressbar until the next run.
  *
 */
 void GUI::on_notification() {
-    if (worker_thread && worker.has_stopped()) {
-        if (worker_thread->joinable()) 
-            worker_thread->join();
-        delete worker_thread;
-        worker_thread = nullptr;
-        update_buttons();
-        update_progress();
-        Glib::ustring text;
-        worker.get_final_data(&text);
-        std::string temp(text.c_str());
-        if (temp[0] == '-') {
-            textout.set_markup("<span font_desc='Helvetica 15'>"+temp.substr(1,temp.size())+"</span>");
+    update_buttons();
+
+    ArtBuffer art;
+    ArtStatus status;
+    unsigned long job, revision;
+    if (worker.get_final_data(&art, &status, &job, &revision) && job == latest_job && revision != shown_revision) {
+        shown_revision = revision;
+        if (status != ArtStatus::art) {
+            textout.set_markup(std::string("<span font_desc='Helvetica 15'>") + status_message(status) + "</span>");
+            textout.set_visible(true);
+            artview.clear();
+            artview.set_visible(false);
             set_default_size(500, 300);
         } else {
-            textout.set_markup("<span font_desc='Menlo 1.7' line_height='0.4'>"+std::string(g_markup_escape_text(temp.c_str(), temp.size()))+"</span>");
+            // fit new art to the same space the size limit allows
+            artview.set_text(std::move(art), s.char_aspect, rect.width-50, rect.height-280);
+            artview.set_visible(true);
+            textout.set_visible(false);
             set_default_size(1, 1);
         }
 
     }
+
+    PlaybackStats stats;
+    if (worker.get_playback_stats(&stats, &job) && job != shown_playback) {
+        shown_playback = job;
+        progressbar.set_text(playback_message(stats));
+        progressbar.set_show_text(true);
+    }
     update_progress();
 }
 
 
+/**
+ * Called when GUI::export_dispatcher's emit() function is called
+ * and shows how far the GUI::exporter has got on the
+ * GUI::progressbar. When the export is over, the
+ * GUI::export_file_button is turned back on.
+ *
+*/
+void GUI::on_export_notification() {
+    double donefrac;
+    bool succeeded;
+    exporter.get_progress(&donefrac, &succeeded);
+    progressbar.set_fraction(donefrac);
+
+    if (!exporter.running()) {
+        update_buttons();
+        if (!succeeded) {
+            std::cout << "Error: could not export the art" << std::endl;
+        }
+    }
+}
+
 /**
  * @ingroup SignalFunctions
  *
- * Creates a new thread assigned to GUI::worker_thread and
- * calls Worker::work() inside the new thread
+ * Sends a job to the GUI::worker. If a job is already
+ * running with different parameters, it's stopped and
+ * replaced by this one.
  *
 */
 void GUI::run_button_clicked() {
-    textout.set_text(""); // clear the textout
+    // the old text stays up until the new text replaces it
+    GdkSurface *surface = gdk_surface_new_toplevel(gdk_display_get_default());
     gdk_monitor_get_geometry( // gets the screen dimensions
-        gdk_display_get_monitor_at_surface(gdk_display_get_default(), 
-        gdk_surface_new_toplevel(gdk_display_get_default())), &this->rect);
+        gdk_display_get_monitor_at_surface(gdk_display_get_default(), surface), &this->rect);
+    gdk_surface_destroy(surface); // runs happen on every scale change now, so don't leak a surface each time
+    g_object_unref(surface);
 
-    
-    if (worker_thread) { 
-        std::cout << "worker thread already running" << std::endl;
-    } else {
-        worker_thread = new std::thread (
-            [this] {
-                worker.work(this, filename, sfactor, rect.width, rect.height, s);
-            }
-        );
-    }
+    latest_job = worker.submit(filename, sfactor, rect.width, rect.height, s);
+    progressbar.set_show_text(false); // the stats of the last animation are replaced by the progress of this job
 
-    update_buttons(); 
+    update_buttons();
 }
\ No newline at end of file
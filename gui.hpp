@@ -1,6 +1,8 @@
 #include "gtkmm/gestureclick.h"
 #include "worker.hpp"
 #include "extras.hpp"
+#include "artview.hpp"
+#include "exporter.hpp"
 #include <gtkmm.h>
 #include <iostream>
 #include <string>
@@ -28,12 +30,10 @@ class GUI : public Gtk::Window {
         GUI(); ///< The constructor for the GUI class. 
         virtual ~GUI(); ///< The GUI class destructor 
         void notify(); ///< A public function to signal the GUI::dispatcher 
-        void pulse_pbar(); ///< A public function to pulse the GUI::progressbar 
-        std::string to_rtf(std::string text); ///< A public function to make text RTF format compatible
 
     protected:
         void mouse_clicked(int numpresses, double x, double y); ///< A function to disable right clicks
-        void run_button_clicked(); ///< A function called when the GUI::run_button is clicked that starts Worker::work() in a new thread
+        void run_button_clicked(); ///< A function called when the GUI::run_button is clicked that sends a job to the GUI::worker
         void clear_button_clicked(); ///< A function called when the GUI::clear_button is clicked that clears the text in GUI::textout
         void scale_factor_changed(); ///< A function called when the GUI::scale_factor is changed 
         void on_choose_file_button_clicked(); ///< A function called when the GUI::choose_file_button button is clicked 
@@ -51,7 +51,8 @@ class GUI : public Gtk::Window {
 
         void update_progress(); ///< A function to update the GUI::progressbar when the GUI::worker is running 
         void update_buttons(); ///< A function to enable or disable UI buttons 
-        void on_notification(); ///< A function to update the UI and manage the GUI::worker_thread 
+        void on_notification(); ///< A function to update the UI and show the result of the latest job
+        void on_export_notification(); ///< A function to show how far the GUI::exporter has got
 
         Gtk::Box vbox, hbox1, hbox2, hbox3; ///< Invisible UI box to control layout
         Glib::RefPtr<Gtk::CssProvider> css_provider; ///< A CSS provider to style the UI
@@ -68,13 +69,18 @@ class GUI : public Gtk::Window {
         Gtk::ProgressBar progressbar; ///< A progressbar to display the progress of the conversion process
         Glib::Dispatcher dispatcher; ///< A dispatcher to signal when to update the main UI
         Worker worker; ///< A custom worker class to do work in a seperate thread
-        std::thread* worker_thread; ///< The thread that the worker will run in
+        unsigned long latest_job; ///< The ID of the last job sent to the GUI::worker, 0 if none has been
+        unsigned long shown_revision; ///< The revision of the text in GUI::textout, see Worker::get_final_data()
+        unsigned long shown_playback; ///< The ID of the job whose playback stats are on GUI::progressbar, 0 if none are
 
         std::string filename; ///< The name of the file that's being converted
         std::string text;
-        Gtk::Label textout; ///< Where to put the generated ascii art text
+        Gtk::Label textout; ///< Where to put messages, like when the image couldn't be read
+        ArtView artview; ///< Where to put the generated ascii art text
 
         Gtk::Button copy_button, export_file_button; ///< A button to save the generated text
+        Glib::Dispatcher export_dispatcher; ///< A dispatcher to signal when the GUI::exporter has progress to show
+        ExportTask exporter; ///< Saves the art on a thread of its own, destroyed before GUI::export_dispatcher
         Gtk::Button help_button; ///< A button to open the help window
         HelpWindow *help_window; ///< A pointer to the help window
 
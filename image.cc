@@ -0,0 +1,90 @@
+#include "image.hpp"
+#include <cstring>
+#include <new>
+#include <utility>
+
+/**
+ * @file image.cc
+ *
+*/
+
+/// The alignment of every row of a LumImage, enough for any SIMD load
+constexpr std::size_t row_alignment = 64;
+
+void LumImage::AlignedDelete::operator()(unsigned char *p) const {
+    ::operator delete[](p, std::align_val_t(row_alignment));
+}
+
+LumImage::LumImage() : pixels(), w(0), h(0), s(0) {}
+
+/**
+ * @param[in] width the width of the image
+ * @param[in] height the height of the image
+ *
+*/
+LumImage::LumImage(int width, int height) : LumImage() {
+    resize(width, height);
+}
+
+LumImage::LumImage(const LumImage &other) : LumImage() {
+    *this = other;
+}
+
+LumImage &LumImage::operator=(const LumImage &other) {
+    if (this != &other) {
+        resize(other.w, other.h);
+        if (!empty()) {
+            std::memcpy(pixels.get(), other.pixels.get(), s * h);
+        }
+    }
+    return *this;
+}
+
+/**
+ * Takes the buffer of other and sets its size to 0, so it's
+ * empty instead of claiming rows it no longer has.
+ *
+ * @param[in,out] other the image to move from
+ *
+*/
+LumImage::LumImage(LumImage &&other) noexcept :
+    pixels(std::move(other.pixels)),
+    w(std::exchange(other.w, 0)),
+    h(std::exchange(other.h, 0)),
+    s(std::exchange(other.s, 0))
+{}
+
+/**
+ * @param[in,out] other the image to move from, which is left empty
+ *
+*/
+LumImage &LumImage::operator=(LumImage &&other) noexcept {
+    if (this != &other) {
+        pixels = std::move(other.pixels);
+        w = std::exchange(other.w, 0);
+        h = std::exchange(other.h, 0);
+        s = std::exchange(other.s, 0);
+    }
+    return *this;
+}
+
+/**
+ * Allocates a buffer for an image of the given size. The old
+ * values are lost and the new ones are uninitialized.
+ *
+ * @param[in] width the width of the image
+ * @param[in] height the height of the image
+ *
+*/
+void LumImage::resize(int width, int height) {
+    std::size_t stride = ((std::size_t)width + row_alignment - 1) / row_alignment * row_alignment;
+
+    if (!pixels || stride * height > s * h) { // reuse the buffer if it's big enough
+        pixels.reset(static_cast<unsigned char *>(
+            ::operator new[](stride * height + row_alignment, std::align_val_t(row_alignment))));
+    }
+
+    w = width;
+    h = height;
+    s = stride;
+}
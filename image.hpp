@@ -0,0 +1,103 @@
+#include <cstddef>
+#include <memory>
+
+#pragma once
+
+/**
+ * @file image.hpp
+ *
+*/
+
+/**
+ * @brief A read only window onto rows of luminance values
+ *
+ * A structure that points at 8-bit luminance values laid out
+ * row after row, stride bytes apart. It doesn't own the values,
+ * so it's cheap to pass around and to cut into bands of rows.
+ *
+*/
+struct LumView {
+    const unsigned char *data = nullptr; ///< The first value of the first row
+    int width = 0; ///< The number of values in each row
+    int height = 0; ///< The number of rows
+    std::size_t stride = 0; ///< The number of bytes from the start of one row to the start of the next
+
+    /// A function that returns a pointer to the first value of row y
+    const unsigned char *row(int y) const {
+        return data + (std::size_t)y * stride;
+    }
+
+    /// A function that returns a view of rows begin to end (not including end)
+    LumView rows(int begin, int end) const {
+        return LumView{row(begin), width, end - begin, stride};
+    }
+};
+
+/**
+ * @brief An image of 8-bit luminance values
+ *
+ * A class that holds a whole grayscale image in one buffer, with
+ * each row starting on a 64 byte boundary. Rows are padded up to
+ * the stride and the buffer has 64 spare bytes at the end, so SIMD
+ * code can load a full vector from the end of any row. The values
+ * in the padding are unspecified.
+ *
+*/
+class LumImage {
+    public:
+        LumImage(); ///< The LumImage constructor for an empty image
+        LumImage(int width, int height); ///< The LumImage constructor, allocates an image of the given size
+        LumImage(const LumImage &other); ///< The LumImage copy constructor
+        LumImage(LumImage &&other) noexcept; ///< The LumImage move constructor, leaves other empty
+        LumImage &operator=(const LumImage &other); ///< The LumImage copy assignment operator
+        LumImage &operator=(LumImage &&other) noexcept; ///< The LumImage move assignment operator, leaves other empty
+
+        void resize(int width, int height); ///< A function to reallocate the image, losing its values
+
+        int width() const { return w; } ///< A function that returns the width of the image
+        int height() const { return h; } ///< A function that returns the height of the image
+        std::size_t stride() const { return s; } ///< A function that returns the bytes between the starts of rows
+        bool empty() const { return w == 0 || h == 0; } ///< A function that returns whether the image has no pixels
+
+        /// A function that returns a pointer to the first value of row y
+        unsigned char *row(int y) { return pixels.get() + (std::size_t)y * s; }
+        /// A function that returns a const pointer to the first value of row y
+        const unsigned char *row(int y) const { return pixels.get() + (std::size_t)y * s; }
+
+        /// A function that returns a LumView of the whole image
+        LumView view() const { return LumView{pixels.get(), w, h, s}; }
+
+    private:
+        /// A deleter for memory from aligned operator new
+        struct AlignedDelete {
+            void operator()(unsigned char *p) const;
+        };
+
+        std::unique_ptr<unsigned char[], AlignedDelete> pixels; ///< The buffer holding every row
+        int w; ///< The width of the image
+        int h; ///< The height of the image
+        std::size_t s; ///< The stride of the image
+};
+
+/**
+ * @brief An image of 8-bit red, green and blue values
+ *
+ * A structure that holds a color image as three LumImage planes,
+ * one for each channel, so every plane can be scaled with the
+ * same code as a grayscale image.
+ *
+*/
+struct RgbImage {
+    LumImage planes[3]; ///< The red, green and blue planes, all the same size
+
+    /// A function to reallocate every plane, losing their values
+    void resize(int width, int height) {
+        for (LumImage &plane : planes) {
+            plane.resize(width, height);
+        }
+    }
+
+    int width() const { return planes[0].width(); } ///< A function that returns the width of the image
+    int height() const { return planes[0].height(); } ///< A function that returns the height of the image
+    bool empty() const { return planes[0].empty(); } ///< A function that returns whether the image has no pixels
+};
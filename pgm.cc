@@ -0,0 +1,652 @@
+#include "pgm.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @file pgm.cc
+ *
+*/
+
+/**
+ * Opens the file at path and maps it into memory. If anything
+ * goes wrong, MappedFile::is_open() returns false.
+ *
+ * @param[in] path the path of the file to map
+ *
+*/
+MappedFile::MappedFile(const std::string &path) : bytes(nullptr), length(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            bytes = static_cast<const unsigned char *>(mapping);
+            length = info.st_size;
+            madvise(mapping, length, MADV_SEQUENTIAL); // the pixels are read front to back
+        }
+    }
+    close(fd); // the mapping stays valid after the file is closed
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) {
+        munmap(const_cast<unsigned char *>(bytes), length);
+    }
+}
+
+/**
+ * @return whether the file was mapped into memory
+ *
+*/
+bool MappedFile::is_open() const {
+    return bytes != nullptr;
+}
+
+/**
+ * @return a pointer to the first byte of the file
+ *
+*/
+const unsigned char *MappedFile::data() const {
+    return bytes;
+}
+
+/**
+ * @return the size of the file in bytes
+ *
+*/
+std::size_t MappedFile::size() const {
+    return length;
+}
+
+/**
+ * Tells the system that the pages before end won't be read
+ * again, so they don't count towards the memory the program
+ * uses. They are read from the file again if they are needed.
+ *
+ * @param[in] end the offset of the first byte that's still needed
+ *
+*/
+void MappedFile::drop(std::size_t end) const {
+    std::size_t page = sysconf(_SC_PAGESIZE);
+    end = std::min(end, length) / page * page;
+    if (bytes && end > 0) {
+        madvise(const_cast<unsigned char *>(bytes), end, MADV_DONTNEED);
+    }
+}
+
+/**
+ * @brief Skips whitespace and comments in a .pgm header
+ *
+ * @param[in] data the start of the file
+ * @param[in] size the size of the file
+ * @param[in,out] pos the position to start at, moved to the next token
+ *
+*/
+static void skip_header_space(const unsigned char *data, std::size_t size, std::size_t &pos) {
+    while (pos < size) {
+        if (data[pos] == '#') { // comments run to the end of the line
+            while (pos < size && data[pos] != '\n' && data[pos] != '\r') {
+                pos++;
+            }
+        } else if (std::isspace(data[pos])) {
+            pos++;
+        } else {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Reads one positive number from a .pgm header
+ *
+ * @param[in] data the start of the file
+ * @param[in] size the size of the file
+ * @param[in,out] pos the position of the number, moved past it
+ * @param[out] value the number that was read
+ * @return whether a number was read
+ *
+*/
+static bool read_header_number(const unsigned char *data, std::size_t size, std::size_t &pos, int &value) {
+    skip_header_space(data, size, pos);
+
+    long long number = 0;
+    std::size_t start = pos;
+    while (pos < size && std::isdigit(data[pos])) {
+        number = number * 10 + (data[pos] - '0');
+        if (number > 0x7fffffff) { // nothing sensible is this big
+            return false;
+        }
+        pos++;
+    }
+    value = number;
+
+    return pos != start && number > 0;
+}
+
+/**
+ * @brief Reads the header of a .pgm file
+ *
+ * Takes the contents of a binary (P5) or plain (P2) .pgm file,
+ * or a binary (P6) .ppm file, and reads the magic number, width,
+ * height and maxval, skipping any comments and whitespace between
+ * them. Only the header has to be there, so it can be read before
+ * the pixels arrive; use PgmHeader::complete() to check the pixels
+ * of a binary file.
+ *
+ * @param[in] data the contents of the file
+ * @param[in] size the size of the file in bytes
+ * @param[out] header the header values that were read
+ * @return whether the header is valid
+ *
+*/
+bool parse_pgm_header(const unsigned char *data, std::size_t size, PgmHeader &header) {
+    if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '2' && data[1] != '6')) {
+        return false;
+    }
+    header.binary = data[1] != '2';
+    header.channels = data[1] == '6' ? 3 : 1;
+
+    std::size_t pos = 2;
+    if (!read_header_number(data, size, pos, header.width) ||
+        !read_header_number(data, size, pos, header.height) ||
+        !read_header_number(data, size, pos, header.maxval) ||
+        header.maxval > 65535) {
+        return false;
+    }
+
+    if (pos >= size || !std::isspace(data[pos])) { // exactly one whitespace character comes before the pixels
+        return false;
+    }
+    header.data_offset = pos + 1;
+
+    return true;
+}
+
+/**
+ * @brief Reads one value of a binary .pgm or .ppm file
+ *
+ * @param[in] src the first byte of the value
+ * @param[in] maxval the maxval from the header
+ * @return the value scaled to 0-255
+ *
+*/
+static inline unsigned char read_sample(const unsigned char *src, int maxval) {
+    if (maxval < 256) {
+        return maxval == 255 ? src[0] : std::min((src[0] * 255 + maxval / 2) / maxval, 255);
+    }
+    int value = (src[0] << 8) | src[1];
+    return std::min((value * 255 + maxval / 2) / maxval, 255);
+}
+
+/**
+ * @brief Reads one row of pixels from a binary .pgm or .ppm file
+ *
+ * Reads the pixels straight out of the file contents, scaling them
+ * to 0-255 when the maxval isn't 255. Pixels with a maxval above 255
+ * are two bytes each, most significant byte first. The pixels of a
+ * .ppm file are turned into luminance with the Rec. 709 luma
+ * weights, the same as GdkPixbuf images.
+ *
+ * @param[in] data the contents of the file
+ * @param[in] header the header read by parse_pgm_header()
+ * @param[in] y the row to read
+ * @param[out] row the luminance values of the row, width bytes long
+ *
+*/
+void read_p5_row(const unsigned char *data, const PgmHeader &header, int y, unsigned char *row) {
+    const unsigned char *src = data + header.data_offset + y * header.row_bytes();
+    const int bytes = header.maxval < 256 ? 1 : 2;
+
+    if (header.channels == 3) {
+        for (int x = 0; x < header.width; x++) {
+            const unsigned char *px = src + x * 3 * bytes;
+            int r = read_sample(px, header.maxval);
+            int g = read_sample(px + bytes, header.maxval);
+            int b = read_sample(px + 2 * bytes, header.maxval);
+            row[x] = (54 * r + 183 * g + 19 * b + 128) >> 8; // 0.2126 R + 0.7152 G + 0.0722 B
+        }
+    } else if (header.maxval == 255) {
+        std::copy(src, src + header.width, row);
+    } else {
+        for (int x = 0; x < header.width; x++) {
+            row[x] = read_sample(src + x * bytes, header.maxval);
+        }
+    }
+}
+
+/**
+ * @brief Reads one row of pixels from a binary .pgm or .ppm file in color
+ *
+ * Like read_p5_row(), but keeps the red, green and blue values
+ * apart. Gray pixels have the same value in all three.
+ *
+ * @param[in] data the contents of the file
+ * @param[in] header the header read by parse_pgm_header()
+ * @param[in] y the row to read
+ * @param[out] red the red values of the row, width bytes long
+ * @param[out] green the green values of the row, width bytes long
+ * @param[out] blue the blue values of the row, width bytes long
+ *
+*/
+void read_rgb_row(const unsigned char *data, const PgmHeader &header, int y, unsigned char *red,
+                    unsigned char *green, unsigned char *blue) {
+    if (header.channels == 1) {
+        read_p5_row(data, header, y, red);
+        std::copy(red, red + header.width, green);
+        std::copy(red, red + header.width, blue);
+        return;
+    }
+
+    const unsigned char *src = data + header.data_offset + y * header.row_bytes();
+    const int bytes = header.maxval < 256 ? 1 : 2;
+    for (int x = 0; x < header.width; x++) {
+        const unsigned char *px = src + x * 3 * bytes;
+        red[x] = read_sample(px, header.maxval);
+        green[x] = read_sample(px + bytes, header.maxval);
+        blue[x] = read_sample(px + 2 * bytes, header.maxval);
+    }
+}
+
+/**
+ * @brief Reads the luminance values of a binary pgm file into a LumImage
+ *
+ * Takes the contents of a binary (P5) .pgm or (P6) .ppm file and reads every
+ * row straight out of it with read_p5_row(), so a memory mapped
+ * file is never copied into a string. The rows are split into
+ * bands that are read at the same time on pool.
+ *
+ * @param[in] data the contents of the .pgm file
+ * @param[in] header the header read by parse_pgm_header()
+ * @param[out] image the image to store the luminance values in
+ * @param[in] pool the threads to read the bands on
+ * @param[in] progress a function to report progress to, which can stop the reading
+ * @return false if the reading was stopped
+ *
+*/
+bool read_p5(const unsigned char *data, const PgmHeader &header, LumImage &image, ThreadPool &pool,
+                const ProgressFunc &progress) {
+    image.resize(header.width, header.height);
+
+    SharedProgress shared(progress, header.height);
+    int bands = band_count(pool, header.height, 64);
+
+    pool.run(bands, [&](int band) {
+        int begin = band_begin(header.height, bands, band);
+        int end = band_begin(header.height, bands, band + 1);
+
+        for (int y = begin; y < end; y++) {
+            read_p5_row(data, header, y, image.row(y));
+
+            // checking in on every row would spend more time on the callback than the pixels
+            if ((y - begin) % 64 == 63 && !shared.advance(64)) {
+                return;
+            }
+        }
+        shared.advance((end - begin) % 64);
+    });
+
+    return !shared.stopped();
+}
+
+/**
+ * @brief The state of parse_p2() between blocks of text
+ *
+ * Numbers can be split across the blocks that the SIMD loops
+ * classify, so the number being read and where the next pixel
+ * goes are kept here.
+ *
+*/
+struct P2State {
+    LumImage &image; ///< The image to store the luminance values in
+    int maxval; ///< The maxval from the header
+    int x; ///< The column the next pixel goes in
+    int y; ///< The row the next pixel goes in
+    unsigned char *out; ///< The row the next pixel goes in
+    unsigned int value; ///< The digits of the current number read so far
+    bool in_number; ///< Whether the last byte of the previous block was a digit
+};
+
+/**
+ * @brief Stores the number that was just read as the next pixel
+ *
+ * @param[in,out] st the state of the parser
+ *
+*/
+static inline __attribute__((always_inline)) void p2_emit(P2State &st) {
+    unsigned int value = std::min(st.value, (unsigned int)st.maxval);
+    if (st.maxval != 255) {
+        value = (value * 255 + st.maxval / 2) / st.maxval;
+    }
+    st.out[st.x] = value;
+    st.value = 0;
+    st.in_number = false;
+
+    if (++st.x == st.image.width()) {
+        st.x = 0;
+        if (++st.y < st.image.height()) {
+            st.out = st.image.row(st.y);
+        }
+    }
+}
+
+/**
+ * @brief Reads every number in one block of text
+ *
+ * Takes a block of up to 32 bytes and a bit mask with a bit set
+ * for every digit, and walks the runs of digits with
+ * count-trailing-zeros, so whitespace of any kind and length is
+ * skipped without looking at it byte by byte.
+ *
+ * @param[in,out] st the state of the parser
+ * @param[in] p the start of the block
+ * @param[in] mask bit i is set if p[i] is a digit
+ * @param[in] width the number of bytes in the block
+ *
+*/
+static inline __attribute__((always_inline)) void p2_block(P2State &st, const unsigned char *p,
+                                                            std::uint64_t mask, int width) {
+    int pos = 0;
+    while (pos < width && st.y < st.image.height()) {
+        std::uint64_t rest = mask >> pos;
+        if (!st.in_number) {
+            if (rest == 0) { // nothing but whitespace left
+                return;
+            }
+            pos += __builtin_ctzll(rest);
+            rest = mask >> pos;
+            st.in_number = true;
+        }
+
+        int run = std::min(__builtin_ctzll(~rest), width - pos); // the number of digits in a row
+        for (int i = 0; i < run; i++) {
+            if (st.value < 100000000) { // nothing sensible is this big, so stop before it overflows
+                st.value = st.value * 10 + (p[pos+i] - '0');
+            }
+        }
+        pos += run;
+
+        if (pos < width) { // the number ended inside this block
+            p2_emit(st);
+        }
+    }
+}
+
+/**
+ * @brief Classifies the bytes of a block without SIMD
+ *
+ * @param[in] p the start of the block
+ * @param[in] width the number of bytes in the block, at most 64
+ * @return a mask with bit i set if p[i] is a digit
+ *
+*/
+static inline std::uint64_t digit_mask_scalar(const unsigned char *p, int width) {
+    std::uint64_t mask = 0;
+    for (int i = 0; i < width; i++) {
+        mask |= (std::uint64_t)((unsigned char)(p[i] - '0') < 10) << i;
+    }
+    return mask;
+}
+
+/// How many bytes parse_p2() reads between progress reports
+constexpr std::size_t p2_progress_bytes = 1 << 20;
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * @brief Parses blocks of 16 bytes with SSE2
+ *
+ * @param[in,out] st the state of the parser
+ * @param[in] data the text to parse
+ * @param[in] size the size of the text
+ * @param[in,out] pos where to start, moved to the first byte that wasn't parsed
+ * @param[in] progress a function to report progress to, which can stop the parsing
+ * @return false if the parsing was stopped
+ *
+*/
+__attribute__((target("sse2")))
+static bool p2_blocks_sse2(P2State &st, const unsigned char *data, std::size_t size, std::size_t &pos,
+                            const ProgressFunc &progress) {
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+
+    while (pos + 16 <= size && st.y < st.image.height()) {
+        std::size_t stop = std::min(size - 15, pos + p2_progress_bytes);
+        for (; pos < stop && st.y < st.image.height(); pos += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(data + pos));
+            __m128i digits = _mm_sub_epi8(bytes, zero); // '0'-'9' become 0-9, everything else wraps above 9
+            __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digits, nine), digits);
+            p2_block(st, data + pos, (unsigned int)_mm_movemask_epi8(is_digit), 16);
+        }
+        if (!progress((double)pos / size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Parses blocks of 32 bytes with AVX2
+ *
+ * The same as p2_blocks_sse2(), with twice as many bytes
+ * classified at once. Only called on CPUs that support AVX2.
+ *
+ * @param[in,out] st the state of the parser
+ * @param[in] data the text to parse
+ * @param[in] size the size of the text
+ * @param[in,out] pos where to start, moved to the first byte that wasn't parsed
+ * @param[in] progress a function to report progress to, which can stop the parsing
+ * @return false if the parsing was stopped
+ *
+*/
+__attribute__((target("avx2")))
+static bool p2_blocks_avx2(P2State &st, const unsigned char *data, std::size_t size, std::size_t &pos,
+                            const ProgressFunc &progress) {
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+
+    while (pos + 32 <= size && st.y < st.image.height()) {
+        std::size_t stop = std::min(size - 31, pos + p2_progress_bytes);
+        for (; pos < stop && st.y < st.image.height(); pos += 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i *)(data + pos));
+            __m256i digits = _mm256_sub_epi8(bytes, zero);
+            __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digits, nine), digits);
+            p2_block(st, data + pos, (unsigned int)_mm256_movemask_epi8(is_digit), 32);
+        }
+        if (!progress((double)pos / size)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief Parses the numbers in one range of a plain pgm file
+ *
+ * Classifies blocks of bytes with AVX2 or SSE2 when the CPU has
+ * them, and finishes off with plain code. The range must not end
+ * in the middle of a number, so the last number is stored once the
+ * range runs out.
+ *
+ * @param[in,out] st the state of the parser, where the first number in the range goes
+ * @param[in] data the contents of the .pgm file
+ * @param[in] pos the start of the range
+ * @param[in] end the end of the range
+ * @param[in] progress a function that's given pos / end and can stop the parsing
+ * @return false if the parsing was stopped
+ *
+*/
+static bool p2_range(P2State &st, const unsigned char *data, std::size_t pos, std::size_t end,
+                        const ProgressFunc &progress) {
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2 ? !p2_blocks_avx2(st, data, end, pos, progress) : !p2_blocks_sse2(st, data, end, pos, progress)) {
+        return false;
+    }
+#endif
+
+    while (pos < end && st.y < st.image.height()) { // whatever is left, or everything without SIMD
+        std::size_t stop = std::min(end, pos + p2_progress_bytes);
+        for (; pos < stop && st.y < st.image.height(); pos += 32) {
+            int width = std::min<std::size_t>(32, end - pos);
+            p2_block(st, data + pos, digit_mask_scalar(data + pos, width), width);
+        }
+        if (!progress((double)pos / end)) {
+            return false;
+        }
+    }
+    if (st.in_number && st.y < st.image.height()) { // the range ended in the middle of a number
+        p2_emit(st);
+    }
+
+    return true;
+}
+
+/// A function that returns whether a byte is a digit
+static inline bool is_digit(unsigned char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+/**
+ * @brief Counts the numbers in one range of a plain pgm file
+ *
+ * @param[in] data the contents of the .pgm file
+ * @param[in] begin the start of the range, after the header
+ * @param[in] end the end of the range
+ * @return the number of numbers that start in the range
+ *
+*/
+static std::size_t p2_count(const unsigned char *data, std::size_t begin, std::size_t end) {
+    std::size_t count = 0;
+    bool prev = is_digit(data[begin-1]); // a number that started before begin isn't counted again
+    for (std::size_t pos = begin; pos < end; pos++) {
+        bool digit = is_digit(data[pos]);
+        count += digit && !prev;
+        prev = digit;
+    }
+    return count;
+}
+
+/**
+ * @brief Fills in the pixels a short plain pgm file is missing
+ *
+ * @param[out] image the image being parsed into
+ * @param[in] parsed the number of pixels that were in the file
+ *
+*/
+static void p2_fill(LumImage &image, std::size_t parsed) {
+    if (parsed >= (std::size_t)image.width() * image.height()) {
+        return;
+    }
+    int y = parsed / image.width();
+    std::fill(image.row(y) + parsed % image.width(), image.row(y) + image.width(), 0);
+    for (y++; y < image.height(); y++) {
+        std::fill(image.row(y), image.row(y) + image.width(), 0);
+    }
+}
+
+/**
+ * @brief Parses the pixels of a plain pgm file into a LumImage
+ * 
+ * Takes the pixels of a plain (P2) .pgm file, straight out of a
+ * memory mapping, and writes them into a LumImage without making
+ * any strings. Any whitespace between numbers works, including
+ * newlines and several spaces in a row. Missing pixels at the end
+ * of a short file are left black.
+ *
+ * Where a number lands depends on every number before it, so with
+ * more than one thread the text is cut into chunks between numbers
+ * and parsed in two passes. The first counts the numbers in each
+ * chunk, which says which pixel each chunk starts at, and the
+ * second parses every chunk straight into place with p2_range().
+ * 
+ * @param[in] data the contents of the .pgm file
+ * @param[in] size the size of the file
+ * @param[in] header the header read by parse_pgm_header()
+ * @param[out] image the image to store the luminance values in
+ * @param[in] pool the threads to parse the chunks on
+ * @param[in] progress a function to report progress to, which can stop the parsing
+ * @return false if the parsing was stopped
+ *
+*/
+bool parse_p2(const unsigned char *data, std::size_t size, const PgmHeader &header, LumImage &image,
+                ThreadPool &pool, const ProgressFunc &progress) {
+    image.resize(header.width, header.height);
+    const std::size_t pixels = (std::size_t)header.width * header.height;
+    const std::size_t bytes = size - header.data_offset;
+    int chunks = std::min<std::size_t>(pool.size() * 4, bytes / p2_progress_bytes);
+
+    if (chunks <= 1) {
+        P2State st{image, header.maxval, 0, 0, image.row(0), 0, false};
+        if (!p2_range(st, data, header.data_offset, size, progress)) {
+            return false;
+        }
+        p2_fill(image, (std::size_t)st.y * header.width + st.x);
+        return true;
+    }
+
+    std::vector<std::size_t> edges(chunks + 1); // chunk i is edges[i] up to edges[i+1]
+    edges[0] = header.data_offset;
+    edges[chunks] = size;
+    for (int i = 1; i < chunks; i++) {
+        std::size_t edge = std::max(edges[i-1], header.data_offset + bytes * i / chunks);
+        while (edge < size && is_digit(data[edge])) { // move past the number the edge landed in
+            edge++;
+        }
+        edges[i] = edge;
+    }
+
+    SharedProgress shared(progress, 2.0 * bytes);
+    std::vector<std::size_t> first(chunks + 1, 0); // the pixel each chunk starts at
+
+    pool.run(chunks, [&](int i) {
+        for (std::size_t pos = edges[i]; pos < edges[i+1] && !shared.stopped(); pos += p2_progress_bytes) {
+            std::size_t stop = std::min(edges[i+1], pos + p2_progress_bytes);
+            first[i+1] += p2_count(data, pos, stop);
+            shared.advance(stop - pos);
+        }
+    });
+    for (int i = 0; i < chunks; i++) {
+        first[i+1] += first[i];
+    }
+
+    pool.run(chunks, [&](int i) {
+        if (first[i] >= pixels || shared.stopped()) {
+            return;
+        }
+        int y = first[i] / header.width;
+        int x = first[i] % header.width;
+        P2State st{image, header.maxval, x, y, image.row(y), 0, false};
+
+        std::size_t end = edges[i+1];
+        std::size_t reported = edges[i];
+        p2_range(st, data, edges[i], end, [&](double frac) {
+            std::size_t pos = std::min<std::size_t>(frac * end + 0.5, end); // p2_range() reports pos / end
+            bool go = shared.advance(pos - reported);
+            reported = pos;
+            return go;
+        });
+        shared.advance(end - reported);
+    });
+    if (shared.stopped()) {
+        return false;
+    }
+
+    p2_fill(image, first[chunks]);
+
+    return true;
+}
@@ -0,0 +1,92 @@
+#include <cstddef>
+#include <functional>
+#include <string>
+#include "image.hpp"
+
+class ThreadPool;
+
+#pragma once
+
+/**
+ * @file pgm.hpp
+ *
+*/
+
+/// A function that's given the fraction of work done and returns false to stop
+using ProgressFunc = std::function<bool(double)>;
+
+/**
+ * @brief The values stored in the header of a .pgm file
+ *
+ * A structure that holds everything read from the header
+ * of a binary (P5) or plain (P2) .pgm file, or a binary (P6)
+ * .ppm file, along with where the pixel data starts.
+ *
+*/
+struct PgmHeader {
+    bool binary = false; ///< Whether the file is a binary P5 or P6 file (false means a plain P2 file)
+    int channels = 1; ///< The number of values per pixel, 1 for gray or 3 for red, green and blue
+    int width = 0; ///< The width of the image
+    int height = 0; ///< The height of the image
+    int maxval = 0; ///< The largest value a pixel can have (1-65535)
+    std::size_t data_offset = 0; ///< The offset of the first pixel byte from the start of the file
+
+    /// A function that returns the number of bytes one row of a binary file takes up
+    std::size_t row_bytes() const {
+        return (std::size_t)width * channels * (maxval < 256 ? 1 : 2);
+    }
+
+    /// A function that returns the number of bytes the pixels of a binary file take up
+    std::size_t pixel_bytes() const {
+        return row_bytes() * height;
+    }
+
+    /// A function that returns whether a binary file of size bytes holds every pixel
+    bool complete(std::size_t size) const {
+        return size >= data_offset && size - data_offset >= pixel_bytes();
+    }
+};
+
+/**
+ * @brief A class to memory map a file read only
+ *
+ * A class that maps a whole file into memory so it can be read
+ * without copying it into a string first. The mapping is removed
+ * when the object is destroyed.
+ *
+*/
+class MappedFile {
+    public:
+        MappedFile(const std::string &path); ///< The MappedFile constructor, maps the file at path
+        ~MappedFile(); ///< The MappedFile destructor, unmaps the file
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool is_open() const; ///< A function that returns whether the file was mapped
+        const unsigned char *data() const; ///< A function that returns a pointer to the start of the mapping
+        std::size_t size() const; ///< A function that returns the size of the mapping in bytes
+        void drop(std::size_t end) const; ///< A function to let the system forget the pages before end
+
+    private:
+        const unsigned char *bytes; ///< The start of the mapping, or nullptr if the file couldn't be mapped
+        std::size_t length; ///< The length of the mapping in bytes
+};
+
+/// A function to read the header of a .pgm file
+bool parse_pgm_header(const unsigned char *data, std::size_t size, PgmHeader &header);
+
+/// A function to read one row of P5 or P6 pixels into luminance values
+void read_p5_row(const unsigned char *data, const PgmHeader &header, int y, unsigned char *row);
+
+/// A function to read one row of P5 or P6 pixels into red, green and blue values
+void read_rgb_row(const unsigned char *data, const PgmHeader &header, int y, unsigned char *red,
+                    unsigned char *green, unsigned char *blue);
+
+/// A function to read every pixel of a binary .pgm or .ppm file into a LumImage, in bands of rows on pool
+bool read_p5(const unsigned char *data, const PgmHeader &header, LumImage &image, ThreadPool &pool,
+                const ProgressFunc &progress);
+
+/// A function to parse the pixels of a plain .pgm file into a LumImage, in chunks of text on pool
+bool parse_p2(const unsigned char *data, std::size_t size, const PgmHeader &header, LumImage &image,
+                ThreadPool &pool, const ProgressFunc &progress);
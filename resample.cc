@@ -0,0 +1,307 @@
+#include "resample.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @file resample.cc
+ *
+*/
+
+/// The number of bytes that can always be read past the end of a row, see LumImage
+constexpr int row_slack = 64;
+
+/**
+ * @brief The sinc function, sin(pi x) / (pi x)
+ *
+ * @param[in] x where to evaluate it
+ * @return sinc(x)
+ *
+*/
+static double sinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= M_PI;
+    return std::sin(x) / x;
+}
+
+/**
+ * @brief Evaluates a filter
+ *
+ * @param[in] filter the filter to evaluate
+ * @param[in] x the distance from the center of the filter, in source pixels
+ * @return the unnormalized weight at x
+ *
+*/
+static double filter_weight(Filter filter, double x) {
+    switch (filter) {
+        case Filter::box:
+            return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+        case Filter::bilinear:
+            x = std::fabs(x);
+            return x < 1.0 ? 1.0 - x : 0.0;
+        case Filter::lanczos:
+            return (x > -3.0 && x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+    return 0.0;
+}
+
+/**
+ * @brief Returns how far a filter reaches from its center
+ *
+ * @param[in] filter the filter
+ * @return the support of the filter in source pixels at a scale of 1
+ *
+*/
+static double filter_support(Filter filter) {
+    switch (filter) {
+        case Filter::box:
+            return 0.5;
+        case Filter::bilinear:
+            return 1.0;
+        case Filter::lanczos:
+            return 3.0;
+    }
+    return 1.0;
+}
+
+/**
+ * @brief Works out the weights for scaling along one axis
+ *
+ * Centers the filter on each output pixel and stretches it by the
+ * scale when shrinking, so every source pixel contributes to the
+ * output. The weights are normalized, rounded to 14 bit fixed
+ * point and nudged so that they add up to exactly 1.0, which keeps
+ * flat areas exactly flat.
+ *
+ * @param[in] src the number of source pixels
+ * @param[in] dst the number of output pixels
+ * @param[in] filter the filter to use
+ * @return the weights for every output pixel
+ *
+*/
+WeightTable make_weights(int src, int dst, Filter filter) {
+    double scale = (double)src / dst;
+    double filterscale = std::max(scale, 1.0);
+    double support = filter_support(filter) * filterscale;
+    int max_count = std::min((int)std::ceil(support) * 2 + 1, src);
+
+    WeightTable table;
+    table.taps = (max_count + 7) / 8 * 8;
+    table.offset.resize(dst);
+    table.count.resize(dst);
+    table.weights.assign((std::size_t)dst * table.taps, 0);
+
+    std::vector<double> w(max_count);
+
+    for (int i = 0; i < dst; i++) {
+        double center = (i + 0.5) * scale;
+        int first = std::max((int)(center - support + 0.5), 0);
+        int last = std::min((int)(center + support + 0.5), src);
+        int count = std::clamp(last - first, 1, max_count);
+        first = std::min(first, src - count);
+
+        double sum = 0.0;
+        for (int j = 0; j < count; j++) {
+            w[j] = filter_weight(filter, (first + j - center + 0.5) / filterscale);
+            sum += w[j];
+        }
+        if (sum == 0.0) { // rounding left nothing under the filter, so take the nearest pixel
+            std::fill(w.begin(), w.begin() + count, 0.0);
+            w[std::clamp((int)center - first, 0, count - 1)] = sum = 1.0;
+        }
+
+        std::int16_t *fixed = table.weights.data() + (std::size_t)i * table.taps;
+        int total = 0;
+        int biggest = 0;
+        for (int j = 0; j < count; j++) {
+            fixed[j] = (std::int16_t)std::lround(w[j] / sum * (1 << weight_bits));
+            total += fixed[j];
+            if (fixed[j] > fixed[biggest]) {
+                biggest = j;
+            }
+        }
+        fixed[biggest] += (1 << weight_bits) - total;
+
+        table.offset[i] = first;
+        table.count[i] = count;
+    }
+
+    return table;
+}
+
+/**
+ * Works out the weight tables for both axes.
+ *
+ * @param[in] width the width of the source
+ * @param[in] height the height of the source
+ * @param[in] destw the width of the output
+ * @param[in] desth the height of the output
+ * @param[in] filter the filter to scale with
+ *
+*/
+Resampler::Resampler(int width, int height, int destw, int desth, Filter filter) :
+    sw(width), dw(destw), dh(desth),
+    xweights(make_weights(width, destw, filter)),
+    yweights(make_weights(height, desth, filter)) {
+    max_rows = *std::max_element(yweights.count.begin(), yweights.count.end());
+}
+
+/**
+ * @brief Rounds a fixed point sum back to a pixel value
+ *
+ * @param[in] sum a sum of pixels times 14 bit weights
+ * @return the pixel value, clamped to 0-255
+ *
+*/
+static inline unsigned char round_pixel(int sum) {
+    return std::clamp((sum + (1 << (weight_bits - 1))) >> weight_bits, 0, 255);
+}
+
+/**
+ * Scales one row to the output width. Up to 64 bytes past the end
+ * of src may be read, which LumImage rows always allow, but they are
+ * always given a weight of 0.
+ *
+ * @param[in] src the source row
+ * @param[out] out the output row, destw values long
+ *
+*/
+void Resampler::horizontal(const unsigned char *src, unsigned char *out) const {
+    const int taps = xweights.taps;
+
+    for (int x = 0; x < dw; x++) {
+        const unsigned char *s = src + xweights.offset[x];
+        const std::int16_t *w = xweights.at(x);
+
+#if defined(__SSE2__)
+        if (xweights.offset[x] + taps <= sw + row_slack) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc = zero;
+            for (int k = 0; k < taps; k += 8) {
+                __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(s + k)), zero);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(pixels, _mm_loadu_si128((const __m128i *)(w + k))));
+            }
+            acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E)); // add the four sums together
+            acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+            out[x] = round_pixel(_mm_cvtsi128_si32(acc));
+            continue;
+        }
+#endif
+
+        int sum = 0;
+        for (int k = 0; k < xweights.count[x]; k++) {
+            sum += s[k] * w[k];
+        }
+        out[x] = round_pixel(sum);
+    }
+}
+
+/**
+ * Fills output row h from the rows of its window, which must
+ * already have been scaled with Resampler::horizontal(). Eight
+ * columns are done at once, two rows at a time, with SSE2.
+ *
+ * @param[in] rows the horizontally scaled rows window_begin(h) to window_begin(h) + window_size(h)
+ * @param[in] h the output row to fill
+ * @param[out] out the output row, destw values long
+ *
+*/
+void Resampler::vertical(const unsigned char *const *rows, int h, unsigned char *out) const {
+    const int count = yweights.count[h];
+    const std::int16_t *w = yweights.at(h);
+    int x = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i half = _mm_set1_epi32(1 << (weight_bits - 1));
+
+    for (; x + 8 <= dw; x += 8) {
+        __m128i acc_lo = half;
+        __m128i acc_hi = half;
+
+        for (int k = 0; k < count; k += 2) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[k] + x)), zero);
+            __m128i b = zero;
+            int pair = (unsigned short)w[k];
+            if (k + 1 < count) {
+                b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[k+1] + x)), zero);
+                pair |= (int)w[k+1] << 16;
+            }
+            __m128i weights = _mm_set1_epi32(pair); // the weights of both rows, side by side
+
+            acc_lo = _mm_add_epi32(acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), weights));
+            acc_hi = _mm_add_epi32(acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), weights));
+        }
+
+        acc_lo = _mm_srai_epi32(acc_lo, weight_bits);
+        acc_hi = _mm_srai_epi32(acc_hi, weight_bits);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(acc_lo, acc_hi), zero); // clamps to 0-255
+        _mm_storel_epi64((__m128i *)(out + x), packed);
+    }
+#endif
+
+    for (; x < dw; x++) {
+        int sum = 0;
+        for (int k = 0; k < count; k++) {
+            sum += rows[k][x] * w[k];
+        }
+        out[x] = round_pixel(sum);
+    }
+}
+
+/**
+ * @brief Scales a whole image
+ *
+ * Scales every source row horizontally into a temporary image,
+ * then fills each output row from its window of those rows. If
+ * the width doesn't change, the horizontal pass is skipped. Each
+ * pass is split into bands of rows that run at the same time on
+ * pool, and every row comes out the same however it's split.
+ *
+ * @param[in] src the image to scale
+ * @param[out] dst the scaled image, resized to destw by desth
+ * @param[in] pool the threads to scale the bands on
+ * @param[in] cancel checked once per row of each pass
+ * @return false if it was cancelled, in which case dst is incomplete
+ *
+*/
+bool Resampler::resample(const LumView &src, LumImage &dst, ThreadPool &pool, const CancelToken *cancel) const {
+    dst.resize(dw, dh);
+
+    LumImage temp;
+    std::vector<const unsigned char *> rows(src.height);
+    if (dw == sw) {
+        for (int y = 0; y < src.height; y++) {
+            rows[y] = src.row(y);
+        }
+    } else {
+        temp.resize(dw, src.height);
+        int bands = band_count(pool, src.height, 16);
+        pool.run(bands, [&](int band) {
+            for (int y = band_begin(src.height, bands, band); y < band_begin(src.height, bands, band + 1) &&
+                                                                !cancelled(cancel); y++) {
+                horizontal(src.row(y), temp.row(y));
+                rows[y] = temp.row(y);
+            }
+        });
+    }
+    if (cancelled(cancel)) {
+        return false;
+    }
+
+    int bands = band_count(pool, dh, 16);
+    pool.run(bands, [&](int band) {
+        for (int h = band_begin(dh, bands, band); h < band_begin(dh, bands, band + 1) && !cancelled(cancel); h++) {
+            vertical(rows.data() + window_begin(h), h, dst.row(h));
+        }
+    });
+
+    return !cancelled(cancel);
+}
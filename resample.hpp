@@ -0,0 +1,91 @@
+#include <cstdint>
+#include <vector>
+#include "image.hpp"
+#include "cancel.hpp"
+
+class ThreadPool;
+
+#pragma once
+
+/**
+ * @file resample.hpp
+ *
+*/
+
+/// The filters a Resampler can scale with
+enum class Filter {
+    box, ///< Averages every source pixel under an output pixel (area averaging)
+    bilinear, ///< A triangle filter, widened when shrinking so no pixels are skipped
+    lanczos ///< A three lobed Lanczos filter, the sharpest of the three
+};
+
+/**
+ * @brief Precomputed weights for scaling along one axis
+ *
+ * A structure that holds, for every output pixel, the first
+ * source pixel it reads and the fixed point weights of the
+ * source pixels from there on. Weights are 14 bit fixed point
+ * (1.0 is 16384) and every output pixel's weights add up to
+ * exactly 1.0.
+ *
+*/
+struct WeightTable {
+    int taps = 0; ///< The number of weights stored per output pixel, padded to a multiple of 8 with zeros
+    std::vector<int> offset; ///< The first source pixel each output pixel reads
+    std::vector<int> count; ///< The number of source pixels each output pixel reads, at most taps
+    std::vector<std::int16_t> weights; ///< taps weights per output pixel
+
+    /// A function that returns the weights of output pixel i
+    const std::int16_t *at(int i) const {
+        return weights.data() + (std::size_t)i * taps;
+    }
+};
+
+/// The number of fractional bits in the weights of a WeightTable
+constexpr int weight_bits = 14;
+
+/// A function to work out the weights for scaling src pixels to dst pixels
+WeightTable make_weights(int src, int dst, Filter filter);
+
+/**
+ * @brief A class to scale luminance images with a separable filter
+ *
+ * A class that scales rows horizontally and then columns
+ * vertically, using weight tables that are worked out once in
+ * the constructor. Both passes use fixed point SIMD kernels where
+ * the CPU has them. The passes can be run on a whole image with
+ * Resampler::resample() or one row at a time for streaming.
+ *
+*/
+class Resampler {
+    public:
+        /// The Resampler constructor, works out the weights for both axes
+        Resampler(int width, int height, int destw, int desth, Filter filter);
+
+        int destw() const { return dw; } ///< A function that returns the width of the output
+        int desth() const { return dh; } ///< A function that returns the height of the output
+
+        /// A function that returns the first source row output row h reads
+        int window_begin(int h) const { return yweights.offset[h]; }
+        /// A function that returns the number of source rows output row h reads
+        int window_size(int h) const { return yweights.count[h]; }
+        /// A function that returns the most source rows any output row reads
+        int max_window() const { return max_rows; }
+
+        /// A function to scale one source row to the output width
+        void horizontal(const unsigned char *src, unsigned char *out) const;
+
+        /// A function to fill output row h from its window of horizontally scaled rows
+        void vertical(const unsigned char *const *rows, int h, unsigned char *out) const;
+
+        /// A function to scale a whole image in bands of rows on pool, false if it was cancelled
+        bool resample(const LumView &src, LumImage &dst, ThreadPool &pool, const CancelToken *cancel = nullptr) const;
+
+    private:
+        int sw; ///< The width of the source
+        int dw; ///< The width of the output
+        int dh; ///< The height of the output
+        int max_rows; ///< The most source rows any output row reads
+        WeightTable xweights; ///< The weights for the horizontal pass
+        WeightTable yweights; ///< The weights for the vertical pass
+};
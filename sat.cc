@@ -0,0 +1,154 @@
+#include "sat.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+
+/**
+ * @file sat.cc
+ *
+*/
+
+/**
+ * Sums each row as it goes and adds the row above. With more than
+ * one thread, the rows are split into bands that are summed as if
+ * each one started at the top of the image. The last row of every
+ * band is then fixed up in order, and the other rows of each band
+ * have the last row of the band before added to them, in parallel.
+ *
+ * @param[in] image the image to build the table from
+ * @param[in] pool the threads to build the bands on
+ * @param[in] cancel checked once per row, if it's set the table is left empty
+ * @return false if it was cancelled
+ *
+*/
+bool SummedAreaTable::build(const LumView &image, ThreadPool &pool, const CancelToken *cancel) {
+    w = image.width;
+    h = image.height;
+    table.assign((std::size_t)(w+1) * (h+1), 0);
+
+    auto row = [this](int y) { return table.data() + (std::size_t)y * (w+1); }; // row y+1 sums image rows 0 to y
+    int bands = band_count(pool, h, 64);
+
+    pool.run(bands, [&](int band) {
+        int begin = band_begin(h, bands, band);
+        int end = band_begin(h, bands, band + 1);
+        const std::vector<std::uint32_t> zeros(band == 0 ? 0 : w+1, 0);
+
+        for (int y = begin; y < end && !cancelled(cancel); y++) {
+            const unsigned char *src = image.row(y);
+            const std::uint32_t *above = y == begin && band > 0 ? zeros.data() : row(y);
+            std::uint32_t *out = row(y+1);
+            std::uint32_t rowsum = 0;
+
+            for (int x = 0; x < w; x++) {
+                rowsum += src[x];
+                out[x+1] = above[x+1] + rowsum;
+            }
+        }
+    });
+
+    if (cancelled(cancel)) {
+        clear();
+        return false;
+    }
+    if (bands == 1) {
+        return true;
+    }
+
+    for (int band = 1; band < bands; band++) { // the last rows, which the next band needs
+        const std::uint32_t *carry = row(band_begin(h, bands, band));
+        std::uint32_t *last = row(band_begin(h, bands, band + 1));
+        for (int x = 1; x <= w; x++) {
+            last[x] += carry[x];
+        }
+    }
+
+    pool.run(bands - 1, [&](int i) {
+        int band = i + 1;
+        int begin = band_begin(h, bands, band);
+        int end = band_begin(h, bands, band + 1);
+        const std::uint32_t *carry = row(begin);
+
+        for (int y = begin + 1; y < end && !cancelled(cancel); y++) { // the last row is already done
+            std::uint32_t *out = row(y);
+            for (int x = 1; x <= w; x++) {
+                out[x] += carry[x];
+            }
+        }
+    });
+
+    if (cancelled(cancel)) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+void SummedAreaTable::clear() {
+    w = h = 0;
+    table.clear();
+    table.shrink_to_fit();
+}
+
+/**
+ * @brief Works out where the boxes along one axis start
+ *
+ * Splits src pixels into dst boxes that are as even as possible.
+ * When there are more boxes than pixels, neighbouring boxes share
+ * a pixel instead.
+ *
+ * @param[in] src the number of source pixels
+ * @param[in] dst the number of boxes
+ * @return dst + 1 edges, box i covers edges[i] up to edges[i+1] (always at least one pixel)
+ *
+*/
+static std::vector<int> box_edges(int src, int dst) {
+    std::vector<int> edges(dst + 1);
+    for (int i = 0; i <= dst; i++) {
+        edges[i] = (int)((long long)i * src / dst);
+    }
+    return edges;
+}
+
+/**
+ * Averages the pixels under every output pixel. The width and
+ * height are scaled separately, so the boxes don't have to be
+ * square, and the scale doesn't have to be a whole number.
+ *
+ * @param[in] destw the width of the output
+ * @param[in] desth the height of the output
+ * @param[out] dst the scaled image, resized to destw by desth
+ * @param[in] pool the threads to fill bands of output rows on
+ * @param[in] cancel checked once per output row
+ * @return false if a box would hold more than max_area pixels, in which case dst is untouched, or it was cancelled
+ *
+*/
+bool SummedAreaTable::box_resample(int destw, int desth, LumImage &dst, ThreadPool &pool,
+                                    const CancelToken *cancel) const {
+    std::uint64_t box_width = (w + destw - 1) / destw + 1;
+    std::uint64_t box_height = (h + desth - 1) / desth + 1;
+    if (empty() || box_width * box_height > max_area) {
+        return false;
+    }
+
+    std::vector<int> xedges = box_edges(w, destw);
+    std::vector<int> yedges = box_edges(h, desth);
+    dst.resize(destw, desth);
+
+    int bands = band_count(pool, desth, 16);
+    pool.run(bands, [&](int band) {
+        for (int j = band_begin(desth, bands, band); j < band_begin(desth, bands, band + 1) && !cancelled(cancel); j++) {
+            int y0 = std::min(yedges[j], h - 1);
+            int y1 = std::max(yedges[j+1], y0 + 1);
+            unsigned char *out = dst.row(j);
+
+            for (int i = 0; i < destw; i++) {
+                int x0 = std::min(xedges[i], w - 1);
+                int x1 = std::max(xedges[i+1], x0 + 1);
+                std::uint32_t area = (x1 - x0) * (y1 - y0);
+                out[i] = (sum(x0, y0, x1, y1) + area / 2) / area;
+            }
+        }
+    });
+
+    return !cancelled(cancel);
+}
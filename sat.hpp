@@ -0,0 +1,53 @@
+#include <cstdint>
+#include <vector>
+#include "image.hpp"
+#include "cancel.hpp"
+
+class ThreadPool;
+
+#pragma once
+
+/**
+ * @file sat.hpp
+ *
+*/
+
+/**
+ * @brief A summed-area table of a luminance image
+ *
+ * A class that holds, for every pixel, the sum of all the pixels
+ * above and to the left of it. Once it's built, the sum of any
+ * rectangle takes four lookups, so the image can be box averaged
+ * down to any size for the cost of the output alone. The sums are
+ * kept modulo 2^32, which still gives exact sums for any rectangle
+ * of up to max_area pixels.
+ *
+*/
+class SummedAreaTable {
+    public:
+        /// The most pixels a rectangle can have and still be summed exactly
+        static constexpr std::uint64_t max_area = 0xFFFFFFFFull / 255;
+
+        /// A function to build the table from an image in bands on pool, false if it was cancelled
+        bool build(const LumView &image, ThreadPool &pool, const CancelToken *cancel = nullptr);
+        void clear(); ///< A function to free the table
+
+        int width() const { return w; } ///< A function that returns the width of the image the table was built from
+        int height() const { return h; } ///< A function that returns the height of the image the table was built from
+        bool empty() const { return w == 0 || h == 0; } ///< A function that returns whether the table has been built
+
+        /// A function that returns the sum of the pixels from (x0, y0) up to but not including (x1, y1)
+        std::uint32_t sum(int x0, int y0, int x1, int y1) const {
+            const std::uint32_t *top = table.data() + (std::size_t)y0 * (w+1);
+            const std::uint32_t *bottom = table.data() + (std::size_t)y1 * (w+1);
+            return bottom[x1] - bottom[x0] - top[x1] + top[x0]; // wraps around, but the result is exact
+        }
+
+        /// A function to box average the image to destw by desth in bands on pool, false if the boxes would be too big or it was cancelled
+        bool box_resample(int destw, int desth, LumImage &dst, ThreadPool &pool, const CancelToken *cancel = nullptr) const;
+
+    private:
+        int w = 0; ///< The width of the image
+        int h = 0; ///< The height of the image
+        std::vector<std::uint32_t> table; ///< (w+1) * (h+1) sums, with a row and column of zeros first
+};
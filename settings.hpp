@@ -1,4 +1,9 @@
+#include <algorithm>
 #include <iostream>
+#include <string>
+#include <thread>
+#include "resample.hpp"
+#include "color.hpp"
 
 #pragma once
 
@@ -18,6 +23,65 @@ struct Settings {
     bool size_limit = true; ///< Whether the output text can be larger than the screen dimensions
     bool dark_mode = false;
     float max_scale_factor = 10.0; ///< The maximum scale factor for the output text
+    float char_aspect = 1.0; ///< How much taller than wide a character is, rows are scaled by this times the scale factor
+    bool low_memory = false; ///< Whether images are streamed a few rows at a time instead of decoded all at once
+    bool progressive = true; ///< Whether a rough preview is shown while a large image decodes
+    bool animate = true; ///< Whether animated GIF and WebP images are played instead of converted as a still
+    Filter filter = Filter::box; ///< The filter used to scale images down
+    int cache_size = 256; ///< The most megabytes the cache of decoded images can use, 0 turns it off
+    int threads = std::max(1u, std::thread::hardware_concurrency()); ///< The number of threads a conversion is split across
+    bool shapes = false; ///< Whether characters are picked by the shape of the pixels they cover, not just their brightness
+    std::string ramp; ///< The characters to draw with, from the least ink to the most, empty for the default ramp
+    ColorMode color = ColorMode::none; ///< How the text is colored with the colors of the image
+
+    bool operator==(const Settings &other) const = default; ///< A function to compare two sets of settings
 };
 
 inline Settings s; ///< A global instance of the Settings struct
+
+/// The stages of a conversion, each one using the result of the one before it
+enum class Stage {
+    decode, ///< Reading the image into luminance values
+    scale, ///< Scaling the luminance values to the size of the text
+    map, ///< Turning the scaled values into characters
+    none ///< Nothing has to be done again
+};
+
+/**
+ * @brief Works out the first stage a change of settings makes stale
+ *
+ * Every setting that changes the text belongs to the first stage
+ * that uses it, and that stage and every one after it have to be
+ * done again when it changes. Settings that only limit the size
+ * of the text or how the work is done don't make any stage stale.
+ *
+ * | Setting            | Stage          |
+ * |--------------------|----------------|
+ * | low_memory         | Stage::decode  |
+ * | animate            | Stage::decode  |
+ * | filter             | Stage::scale   |
+ * | char_aspect        | Stage::scale   |
+ * | shapes             | Stage::scale   |
+ * | dark_mode          | Stage::map     |
+ * | ramp               | Stage::map     |
+ * | color              | Stage::map     |
+ * | everything else    | Stage::none    |
+ *
+ * @param[in] before the settings the stages were done with
+ * @param[in] after the new settings
+ * @return the first stage that has to be done again
+ *
+*/
+inline Stage stale_stage(const Settings &before, const Settings &after) {
+    if (before.low_memory != after.low_memory || before.animate != after.animate) {
+        return Stage::decode;
+    }
+    if (before.filter != after.filter || before.char_aspect != after.char_aspect || before.shapes != after.shapes) {
+        return Stage::scale;
+    }
+    if (before.dark_mode != after.dark_mode || before.ramp != after.ramp ||
+            before.color != after.color) {
+        return Stage::map;
+    }
+    return Stage::none;
+}
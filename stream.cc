@@ -0,0 +1,83 @@
+#include "stream.hpp"
+#include <algorithm>
+#include <vector>
+
+/**
+ * @file stream.cc
+ *
+*/
+
+/// How many source rows are read between checks of the progress function, when an output row needs more than that
+constexpr int stream_check_rows = 64;
+
+/**
+ * @brief Converts a stream of rows to ASCII art
+ *
+ * Pulls rows from source, scales each one horizontally as soon as
+ * it arrives and keeps it in a ring just big enough for the window
+ * of rows one output row needs. Each output row is scaled
+ * vertically and mapped to characters as soon as its window is in
+ * the ring, so the memory used grows with the width of the image,
+ * not its area. progress is checked after every output row, and
+ * every stream_check_rows source rows while the rows for one are
+ * read, so even text a few rows high can be stopped part way.
+ *
+ * @param[in,out] source the rows of the image
+ * @param[in] destw the width of the output
+ * @param[in] desth the height of the output
+ * @param[in] filter the filter to scale with
+ * @param[in] glyphs the character for every luminance value
+ * @param[out] text the ASCII art
+ * @param[in] progress a function to report progress to, which can stop the conversion
+ * @return false if the conversion was stopped or the source ran out of rows
+ *
+*/
+bool convert_stream(RowSource &source, int destw, int desth, Filter filter, const GlyphTable &glyphs, std::string &text,
+                    const ProgressFunc &progress) {
+    Resampler resampler(source.width(), source.height(), destw, desth, filter);
+    const int ring_size = resampler.max_window();
+
+    std::vector<unsigned char> row(source.width() + 64); // room for the SIMD kernels to read past the end
+    std::vector<std::vector<unsigned char>> ring(ring_size, std::vector<unsigned char>(destw + 64));
+    std::vector<const unsigned char *> window(ring_size);
+    std::vector<unsigned char> scaled(destw);
+    int next_row = 0; // the next row source will hand out
+
+    text.clear();
+    text.reserve((std::size_t)(destw+1) * desth);
+
+    for (int h = 0; h < desth; h++) {
+        int begin = resampler.window_begin(h);
+        int end = begin + resampler.window_size(h);
+
+        while (next_row < end) { // rows before the window are read and forgotten
+            if (!source.read_row(row.data())) {
+                return false;
+            }
+            if (next_row >= begin) {
+                resampler.horizontal(row.data(), ring[next_row % ring_size].data());
+            }
+            next_row++;
+
+            if (next_row % stream_check_rows == 0 && !progress((double)next_row / source.height())) {
+                return false;
+            }
+        }
+
+        for (int y = begin; y < end; y++) {
+            window[y - begin] = ring[y % ring_size].data();
+        }
+        resampler.vertical(window.data(), h, scaled.data());
+
+        for (unsigned char px : scaled) {
+            text += glyphs[px];
+        }
+        text += '\n';
+
+        if (!progress((double)(h+1) / desth)) {
+            return false;
+        }
+    }
+
+    return true;
+}
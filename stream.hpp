@@ -0,0 +1,34 @@
+#include <string>
+#include "pgm.hpp"
+#include "resample.hpp"
+#include "glyphs.hpp"
+
+#pragma once
+
+/**
+ * @file stream.hpp
+ *
+*/
+
+/**
+ * @brief A class that hands out an image one row at a time
+ *
+ * A base class for anything that can produce the rows of a
+ * grayscale image from top to bottom without holding the whole
+ * image in memory.
+ *
+*/
+class RowSource {
+    public:
+        virtual ~RowSource() = default; ///< The RowSource destructor
+
+        virtual int width() const = 0; ///< A function that returns the width of the image
+        virtual int height() const = 0; ///< A function that returns the height of the image
+
+        /// A function to read the next row of 0-255 luminance values into row, false if there isn't one
+        virtual bool read_row(unsigned char *row) = 0;
+};
+
+/// A function to convert a stream of rows to ASCII art while keeping only a few source rows in memory
+bool convert_stream(RowSource &source, int destw, int desth, Filter filter, const GlyphTable &glyphs, std::string &text,
+                    const ProgressFunc &progress);
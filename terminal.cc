@@ -0,0 +1,199 @@
+#include "terminal.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/**
+ * @file terminal.cc
+ *
+*/
+
+/// The most unchanged cells between two changes that are sent again rather than skipped with a cursor move
+constexpr int merge_gap = 6;
+
+/**
+ * @brief Appends a cursor move
+ *
+ * Moves to the start of the next row with a carriage return and line
+ * feed, forward on the same row with the shorter relative escape,
+ * and anywhere else with an absolute one.
+ *
+ * @param[in,out] out the string to append to
+ * @param[in] row the row the cursor is on, from 0, or -1 if it isn't known
+ * @param[in] column the column the cursor is on, from 0
+ * @param[in] to_row the row to move to, from 0
+ * @param[in] to_column the column to move to, from 0
+ *
+*/
+static void move_cursor(std::string &out, int row, int column, int to_row, int to_column) {
+    if (row == to_row && column == to_column) {
+        return;
+    }
+    if (row >= 0 && to_row == row + 1 && to_column == 0) {
+        out += "\r\n";
+        return;
+    }
+    if (row == to_row && to_column > column) {
+        out += "\x1b[";
+        out += std::to_string(to_column - column);
+        out += 'C';
+        return;
+    }
+    out += "\x1b[";
+    out += std::to_string(to_row + 1);
+    out += ';';
+    out += std::to_string(to_column + 1);
+    out += 'H';
+}
+
+/**
+ * Hides the cursor, since it would flicker across the art
+ * as it moves from change to change.
+ *
+ * @param[in] fd the terminal to draw on
+ *
+*/
+TerminalRenderer::TerminalRenderer(int fd) : fd(fd), cells(), columns(0), rows(0), sent(0), full(0) {
+    write_all("\x1b[?25l");
+}
+
+/**
+ * Puts the cursor on the line below the text and shows it again,
+ * so the shell prompt doesn't land on top of the art.
+ *
+*/
+TerminalRenderer::~TerminalRenderer() {
+    std::string out;
+    move_cursor(out, -1, 0, std::max(rows - 1, 0), 0);
+    out += "\x1b[?25h\n";
+    write_all(out);
+}
+
+/**
+ * @param[out] columns the width of the terminal in characters
+ * @param[out] rows the height of the terminal in characters
+ * @return false if the size couldn't be read
+ *
+*/
+bool TerminalRenderer::size(int &columns, int &rows) const {
+    winsize ws;
+    if (ioctl(fd, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0) {
+        return false;
+    }
+    columns = ws.ws_col;
+    rows = ws.ws_row;
+    return true;
+}
+
+/**
+ * Makes the next TerminalRenderer::draw() clear the screen and send
+ * every cell, for when the terminal has been resized or written to
+ * by something else.
+ *
+*/
+void TerminalRenderer::invalidate() {
+    cells.clear();
+}
+
+/**
+ * @brief Appends what it takes to turn the cells into next
+ *
+ * Each run of changed cells is sent after a cursor move to its
+ * start, and runs that are only a few cells apart are sent as one,
+ * because sending the cells between them is cheaper than another
+ * move.
+ *
+ * @param[in] next what every cell should show, a row at a time
+ * @param[in] columns the width of the terminal
+ * @param[in] rows the height of the terminal
+ * @param[in,out] out the string to append to
+ *
+*/
+void TerminalRenderer::changes(const std::vector<char> &next, int columns, int rows, std::string &out) const {
+    int cursor_row = -1, cursor_column = 0; // where the cursor is, -1 if it isn't known
+    for (int r = 0; r < rows; r++) {
+        const char *now = cells.data() + (std::size_t)r * columns;
+        const char *want = next.data() + (std::size_t)r * columns;
+
+        for (int c = 0; c < columns; c++) {
+            if (now[c] == want[c]) {
+                continue;
+            }
+            int last = c; // the last changed cell of the run
+            for (int i = c + 1; i < columns && i - last <= merge_gap; i++) {
+                if (now[i] != want[i]) {
+                    last = i;
+                }
+            }
+
+            move_cursor(out, cursor_row, cursor_column, r, c);
+            out.append(want + c, last - c + 1);
+            cursor_row = r;
+            cursor_column = last + 1;
+            c = last;
+        }
+    }
+}
+
+/**
+ * Lays the text out in cells the size of the terminal and compares
+ * them with what the terminal already shows, sending only the cells
+ * that changed. Everything is written at once, so the terminal never
+ * shows half a frame. When the size of the terminal changed,
+ * TerminalRenderer::invalidate() was called, or the changes would
+ * take more bytes than a full repaint, the screen is cleared and
+ * repainted instead.
+ *
+ * @param[in] text the text, with lines ending in '\\n'
+ *
+*/
+void TerminalRenderer::draw(const std::string &text) {
+    int columns = 80, rows = 24;
+    size(columns, rows); // the classic size if it isn't a terminal
+
+    std::vector<char> next((std::size_t)columns * rows, ' ');
+    std::size_t begin = 0;
+    std::size_t repaint = 7; // the clear and cursor home of a full repaint
+    for (int r = 0; r < rows && begin < text.size(); r++) {
+        std::size_t end = std::min(text.find('\n', begin), text.size());
+        std::size_t length = std::min<std::size_t>(end - begin, columns);
+        std::copy(text.begin() + begin, text.begin() + begin + length, next.begin() + (std::size_t)r * columns);
+        repaint += length + 2;
+        begin = end + 1;
+    }
+    full += repaint;
+
+    std::string out;
+    const bool repaint_all = cells.size() != next.size() || columns != this->columns;
+    if (!repaint_all) {
+        changes(next, columns, rows, out);
+    }
+    if (repaint_all || out.size() > repaint) { // so much changed that starting over is cheaper
+        cells.assign(next.size(), ' '); // what a cleared screen shows
+        out = "\x1b[H\x1b[2J";
+        changes(next, columns, rows, out);
+    }
+
+    if (!out.empty()) {
+        write_all(out);
+    }
+    cells = std::move(next);
+    this->columns = columns;
+    this->rows = rows;
+}
+
+void TerminalRenderer::write_all(const std::string &out) {
+    std::size_t done = 0;
+    while (done < out.size()) {
+        ssize_t count = write(fd, out.data() + done, out.size() - done);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return;
+        }
+        done += count;
+    }
+    sent += out.size();
+}
@@ -0,0 +1,44 @@
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/**
+ * @file terminal.hpp
+ *
+*/
+
+/**
+ * @brief A class that draws text on a terminal, sending only what changed
+ *
+ * A class that remembers what every cell of the terminal shows, so
+ * drawing a new frame of text sends just the cursor moves and
+ * characters for the cells that are different. Over a slow link,
+ * like SSH, a frame that changes a little costs a little. The
+ * cursor is hidden while the renderer exists.
+ *
+*/
+class TerminalRenderer {
+    public:
+        TerminalRenderer(int fd); ///< The TerminalRenderer constructor, draws on the terminal fd
+        ~TerminalRenderer(); ///< The TerminalRenderer destructor, shows the cursor again below the text
+
+        bool size(int &columns, int &rows) const; ///< A function to get the size of the terminal, false if fd isn't one
+        void draw(const std::string &text); ///< A function to show text, with lines ending in '\\n', clipped to the terminal
+        void invalidate(); ///< A function to repaint everything on the next draw, because the screen can't be trusted
+
+        std::size_t bytes_sent() const { return sent; } ///< A function that returns how many bytes have been written
+        std::size_t bytes_full() const { return full; } ///< A function that returns how many bytes full repaints would have written
+
+    private:
+        void changes(const std::vector<char> &next, int columns, int rows, std::string &out) const; ///< A function to append the cursor moves and characters that turn cells into next
+        void write_all(const std::string &out); ///< A function to write all of out, however many calls it takes
+
+        int fd; ///< The terminal
+        std::vector<char> cells; ///< What every cell shows, a row at a time, empty if it isn't known
+        int columns; ///< The width of the terminal when it was last drawn on
+        int rows; ///< The height of the terminal when it was last drawn on
+        std::size_t sent; ///< The bytes written so far
+        std::size_t full; ///< The bytes full repaints of every frame would have written
+};
@@ -0,0 +1,212 @@
+#include "threadpool.hpp"
+
+/**
+ * @file threadpool.cc
+ *
+*/
+
+/// The pool the thread is running a task for, nullptr if none
+static thread_local const ThreadPool *current_pool = nullptr;
+/// The queue of ThreadPool::queues the thread puts new tasks on
+static thread_local int current_queue = 0;
+/// How many calls to ThreadPool::run() the task the thread is running is inside, 0 if it isn't running one
+static thread_local int current_depth = 0;
+
+/**
+ * @param[in] threads the number of threads, including the one that calls ThreadPool::run()
+ *
+*/
+ThreadPool::ThreadPool(int threads) {
+    start(threads);
+}
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+/**
+ * Stops the threads and starts new ones if the number changed.
+ * Must not be called while ThreadPool::run() is running.
+ *
+ * @param[in] threads the number of threads, including the one that calls ThreadPool::run()
+ *
+*/
+void ThreadPool::resize(int threads) {
+    if (std::max(threads, 1) != size()) {
+        stop();
+        start(threads);
+    }
+}
+
+void ThreadPool::start(int threads) {
+    quit = false;
+    threads = std::max(threads, 1);
+    for (int i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < threads - 1; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    queues.clear();
+}
+
+/**
+ * Puts the tasks on the queue of the calling thread, or the queue
+ * for threads outside the pool, and works on them until every one
+ * is done, while other threads take the rest. While it waits, the
+ * calling thread only picks up tasks at least as deep as its own,
+ * like the bands of another image, never a whole new image that
+ * would keep it from returning.
+ *
+ * @param[in] count the number of tasks
+ * @param[in] task the task to run, called with every number from 0 to count - 1
+ *
+*/
+void ThreadPool::run(int count, const std::function<void(int)> &task) {
+    if (workers.empty() || count <= 1) {
+        for (int i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    Group group{&task, count};
+    const int index = current_pool == this ? current_queue : (int)queues.size() - 1;
+    const int depth = current_depth + 1;
+    {
+        Queue &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (int i = 0; i < count; i++) {
+            queue.items.push_back({&group, i, depth});
+        }
+    }
+    pushes.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    wake.notify_all();
+
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        unsigned long seen = pushes.load(std::memory_order_acquire);
+        if (run_one(index, depth)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] {
+            return group.pending.load(std::memory_order_acquire) == 0 || pushes.load(std::memory_order_acquire) != seen;
+        });
+    }
+}
+
+/**
+ * Takes the newest task from the thread's own queue, or failing
+ * that the oldest one from any other queue, and runs it. The
+ * oldest tasks are the biggest ones, so a thread that steals
+ * takes as much work as it can at once.
+ *
+ * @param[in] index the queue of the calling thread
+ * @param[in] min_depth the shallowest task to take
+ * @return false if there was no task to run
+ *
+*/
+bool ThreadPool::run_one(int index, int min_depth) {
+    const int n = queues.size();
+    for (int i = 0; i < n; i++) {
+        Queue &queue = *queues[(index + i) % n];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        if (i == 0) { // newer tasks are never shallower, so only the newest one has to be looked at
+            if (queue.items.empty() || queue.items.back().depth < min_depth) {
+                continue;
+            }
+            Item item = queue.items.back();
+            queue.items.pop_back();
+            lock.unlock();
+            execute(item, index);
+            return true;
+        }
+
+        auto it = std::find_if(queue.items.begin(), queue.items.end(), [&](const Item &item) {
+            return item.depth >= min_depth;
+        });
+        if (it != queue.items.end()) {
+            Item item = *it;
+            queue.items.erase(it);
+            lock.unlock();
+            execute(item, index);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Item &item, int index) {
+    const ThreadPool *pool = current_pool;
+    const int queue = current_queue;
+    const int depth = current_depth;
+    current_pool = this;
+    current_queue = index;
+    current_depth = item.depth;
+
+    (*item.group->task)(item.index);
+
+    current_pool = pool;
+    current_queue = queue;
+    current_depth = depth;
+
+    if (item.group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) { // the group may be gone after this
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        wake.notify_all();
+    }
+}
+
+void ThreadPool::worker_loop(int index) {
+    while (true) {
+        unsigned long seen = pushes.load(std::memory_order_acquire);
+        if (run_one(index, 0)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return quit || pushes.load(std::memory_order_acquire) != seen; });
+        if (quit) {
+            return;
+        }
+    }
+}
+
+/**
+ * Adds amount to the work done and reports the new total. The
+ * reports are made one at a time, so the fraction never goes
+ * backwards.
+ *
+ * @param[in] amount the work a band just finished
+ * @return false if the bands should stop
+ *
+*/
+bool SharedProgress::advance(double amount) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopped()) {
+        return false;
+    }
+
+    done += amount;
+    if (!progress(start + scale * done / total)) {
+        stop.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pgm.hpp"
+
+#pragma once
+
+/**
+ * @file threadpool.hpp
+ *
+*/
+
+/**
+ * @brief A class that runs tasks on a set of threads that stay alive
+ *
+ * A class that keeps threads waiting between jobs, so splitting a
+ * stage into bands doesn't cost a thread start every time. The
+ * thread that calls ThreadPool::run() works on the job too, so a
+ * pool of one thread starts no threads at all.
+ *
+ * Every thread has its own queue of tasks. ThreadPool::run() puts
+ * its tasks on the queue of the thread that calls it, which works
+ * through them newest first, and threads that run out of work take
+ * the oldest tasks from the other queues. A task can call
+ * ThreadPool::run() itself, so a batch of images can be run with
+ * one task each while the bands of a big image still spread over
+ * every thread that has nothing else to do.
+ *
+*/
+class ThreadPool {
+    public:
+        ThreadPool(int threads = 1); ///< The ThreadPool constructor, starts threads - 1 threads
+        ~ThreadPool(); ///< The ThreadPool destructor, stops the threads
+
+        void resize(int threads); ///< A function to change the number of threads
+        int size() const { return workers.size() + 1; } ///< A function that returns the number of threads, including the caller
+
+        /// A function to run task(0) to task(count - 1) across the threads and wait for all of them
+        void run(int count, const std::function<void(int)> &task);
+
+    private:
+        /// The tasks one call to ThreadPool::run() is waiting for
+        struct Group {
+            const std::function<void(int)> *task; ///< The task to run
+            std::atomic<int> pending; ///< The number of tasks that haven't finished
+        };
+
+        /// One task on a queue
+        struct Item {
+            Group *group; ///< The call to ThreadPool::run() the task belongs to
+            int index; ///< The number to call the task with
+            int depth; ///< How many calls to ThreadPool::run() the task is inside, 1 for one made outside the pool
+        };
+
+        /// A queue of tasks that belongs to one thread, and that other threads can take from
+        struct Queue {
+            std::mutex mutex; ///< A mutex for Queue::items
+            std::deque<Item> items; ///< The tasks, oldest first
+        };
+
+        void start(int threads); ///< A function to start threads - 1 threads
+        void stop(); ///< A function to stop every thread
+        void worker_loop(int index); ///< The function each thread runs, index is its queue
+        bool run_one(int index, int min_depth); ///< A function to run one task at least min_depth deep, false if there was none
+        void execute(const Item &item, int index); ///< A function to run a task from the thread with queue index and count it as finished
+
+        std::vector<std::thread> workers; ///< The threads, not including the caller
+        std::vector<std::unique_ptr<Queue>> queues; ///< One queue per thread, and a last one for threads outside the pool
+        std::mutex mutex; ///< A mutex to sleep and wake with
+        std::condition_variable wake; ///< Wakes the threads when there are new tasks, a group finishes or they should quit
+        std::atomic<unsigned long> pushes{0}; ///< Counts the calls that put tasks on a queue, so sleeping threads can tell there are new ones
+        bool quit = false; ///< Whether the threads should return
+};
+
+/**
+ * @brief A progress function that many bands report to
+ *
+ * A class that adds up the work done by every band and passes the
+ * total on as a fraction, one report at a time. Once the progress
+ * function asks to stop, every band is told to stop.
+ *
+*/
+class SharedProgress {
+    public:
+        /// The SharedProgress constructor, total is the amount of work that makes 1.0
+        SharedProgress(const ProgressFunc &progress, double total, double start = 0.0, double scale = 1.0) :
+            progress(progress), total(total), start(start), scale(scale) {}
+
+        /// A function to add amount to the work done, false if the bands should stop
+        bool advance(double amount);
+
+        /// A function that returns whether the bands have been asked to stop
+        bool stopped() const { return stop.load(std::memory_order_relaxed); }
+
+    private:
+        const ProgressFunc &progress; ///< The function to report to
+        double total; ///< The amount of work that makes 1.0
+        double start; ///< The fraction to report at no work
+        double scale; ///< How much of the fraction this work covers
+        double done = 0.0; ///< The amount of work done so far
+        std::mutex mutex; ///< A mutex so reports go out one at a time and in order
+        std::atomic<bool> stop{false}; ///< Whether the progress function asked to stop
+};
+
+/// A function to split count items into bands pieces and return where piece i starts (i can be bands)
+inline int band_begin(int count, int bands, int i) {
+    return (int)((long long)count * i / bands);
+}
+
+/// A function that returns how many bands to split count items into, so each band has at least min_size items
+inline int band_count(const ThreadPool &pool, int count, int min_size) {
+    int bands = std::min(pool.size() * 4, count / std::max(min_size, 1)); // a few per thread so uneven bands even out
+    return std::max(bands, 1);
+}
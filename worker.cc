@@ -1,5 +1,6 @@
 #include "worker.hpp"
 #include "gui.hpp"
+#include <iostream>
 #include <mutex>
 
 /**
@@ -14,52 +15,435 @@
 /***/
 Worker::Worker() :
     mutex(),
-    will_stop(false),
+    wake(),
+    thread(),
+    gui(nullptr),
+    pending(),
+    running(),
+    next_id(1),
+    finished_id(0),
+    revision(0),
+    quit(false),
+    will_stop(),
+    cancel_time(),
+    last_latency(0.0),
+    worst_latency(0.0),
     stopped(true),
+    playing(false),
+    playback(),
+    playback_id(0),
     donefrac(0.0),
-    message()
+    loading(false),
+    last_report(0),
+    art(),
+    status(ArtStatus::art),
+    colored(),
+    colored_mode(ColorMode::none),
+    cache(),
+    image(),
+    image_filename(),
+    image_id(),
+    still_filename(),
+    still_id(),
+    store_filename(),
+    store_budget(0),
+    storing(false),
+    sat(),
+    colors(),
+    colors_filename(),
+    scaled_colors(),
+    scaled(),
+    scaled_job(),
+    pool(s.threads),
+    ramps()
 {}
 
+/**
+ * Stops the running job and waits for the thread to return.
+ *
+*/
+Worker::~Worker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        cancel_running();
+        pending.reset();
+    }
+    wake.notify_one();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/**
+ * Starts the thread that runs jobs. It waits for Worker::submit()
+ * until the Worker is destroyed.
+ *
+ * @param[in,out] gui the GUI to notify when there's progress or a result
+ *
+*/
+void Worker::start(GUI *gui) {
+    this->gui = gui;
+    thread = std::thread(&Worker::run, this);
+}
+
+/**
+ * Queues a conversion. If the same conversion is already running
+ * or waiting, nothing changes. Otherwise it replaces any job that's
+ * waiting, and the running job is told to stop so the new one can
+ * start as soon as possible.
+ *
+ * @param[in] filename the file path to the image to convert
+ * @param[in] scale_factor the scale factor to scale the image by
+ * @param[in] swidth the width of the screen
+ * @param[in] sheight the height of the screen
+ * @param[in] s the settings to convert with, which are copied
+ * @return the ID of the job that will make the text
+ *
+*/
+unsigned long Worker::submit(const std::string &filename, float scale_factor, int swidth, int sheight, const Settings &s) {
+    Job job{0, filename, scale_factor, swidth, sheight, s};
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending && pending->same_request(job)) {
+            return pending->id;
+        }
+        if (running && running->same_request(job) && !will_stop.cancelled() && !pending) {
+            return running->id;
+        }
+
+        job.id = next_id++;
+        pending = job;
+        stopped = false;
+        cancel_running(); // supersede the running job
+    }
+    wake.notify_one();
+
+    return job.id;
+}
+
+/**
+ * Waits for a job, takes it and runs it with Worker::work(), then
+ * goes back to waiting. An image the job decoded is saved to the
+ * cache after the job, once its art is up and the buttons are
+ * back on, unless a newer job is waiting, which would stop it.
+ * Returns when the Worker is destroyed.
+ *
+*/
+void Worker::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return quit || pending; });
+            if (quit) {
+                return;
+            }
+
+            job = std::move(*pending);
+            pending.reset();
+            running = job;
+            will_stop.reset();
+            stopped = false;
+            playing = false;
+            donefrac.store(0.0, std::memory_order_relaxed);
+            loading.store(false, std::memory_order_relaxed);
+        }
+
+        work(job);
+
+        bool store;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running.reset();
+            stopped = !pending;
+            playing = false;
+            storing = !store_filename.empty() && !pending && !will_stop.cancelled();
+            store = storing;
+
+            if (will_stop.cancelled()) {
+                last_latency = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - cancel_time).count();
+                worst_latency = std::max(worst_latency, last_latency);
+                if (last_latency > cancel_latency_bound) {
+                    std::cerr << "job " << job.id << " took " << last_latency << " ms to stop" << std::endl;
+                }
+            }
+        }
+        gui->notify();
+
+        if (store) { // the art is already up, so a big image no longer holds it back while it's written
+            cache.store(store_filename, image, store_budget, &will_stop);
+            std::lock_guard<std::mutex> lock(mutex);
+            storing = false;
+        }
+        store_filename.clear();
+    }
+}
+
+/**
+ * Tells the running job to stop and notes the time, so
+ * Worker::run() can measure how long it takes. A job that's
+ * saving its image to the cache is stopped the same way. Does
+ * nothing if no job is running or it's already been told.
+ *
+*/
+void Worker::cancel_running() {
+    if ((running || storing) && !will_stop.cancelled()) {
+        cancel_time = std::chrono::steady_clock::now();
+        will_stop.cancel();
+    }
+}
+
+/**
+ * Sets how long jobs took to stop after being told to,
+ * from the cancel until the thread was free for the next
+ * job. Every stage checks Worker::will_stop often enough
+ * that this should stay under cancel_latency_bound.
+ *
+ * @param[in,out] last a pointer to the time the last stopped job took
+ * @param[in,out] worst a pointer to the longest time any stopped job took
+ *
+*/
+void Worker::get_cancel_latency(double *last, double *worst) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (last)
+        *last = last_latency;
+    if (worst)
+        *worst = worst_latency;
+}
+
+/**
+ * Stores the art a job made, unless the job was stopped or
+ * replaced by a newer one, and tells the GUI about it. A preview
+ * is shown the same way, but the job keeps running and replaces it
+ * with the finished art later. The art is only ever shared, never
+ * copied, so handing over even huge art costs the same.
+ *
+ * @param[in] job the job that made the art
+ * @param[in] art the ASCII art
+ * @param[in] preview whether a later pass of the job will replace the art
+ * @param[in] colored the art with the colors of the image, in the mode the job asked for, or empty
+ *
+*/
+void Worker::finish(const Job &job, ArtBuffer art, bool preview, ArtBuffer colored) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (will_stop.cancelled()) {
+            return;
+        }
+        this->art = std::move(art);
+        status = ArtStatus::art;
+        this->colored = std::move(colored);
+        colored_mode = this->colored ? job.settings.color : ColorMode::none;
+        finished_id = job.id;
+        revision++;
+        if (!preview) {
+            donefrac.store(1.0, std::memory_order_relaxed);
+            loading.store(false, std::memory_order_relaxed);
+        }
+    }
+    gui->notify();
+}
+
+/**
+ * Stores why a job couldn't make any art, unless the job was
+ * stopped or replaced by a newer one, and tells the GUI about it.
+ * The GUI picks the message to show for the status.
+ *
+ * @param[in] job the job that failed
+ * @param[in] status why it failed, never ArtStatus::art
+ *
+*/
+void Worker::fail(const Job &job, ArtStatus status) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (will_stop.cancelled()) {
+            return;
+        }
+        art.reset();
+        this->status = status;
+        colored.reset();
+        colored_mode = ColorMode::none;
+        finished_id = job.id;
+        revision++;
+        donefrac.store(1.0, std::memory_order_relaxed);
+        loading.store(false, std::memory_order_relaxed);
+    }
+    gui->notify();
+}
+
+/**
+ * Publishes how far the running job has got. It's called from
+ * every thread of Worker::pool, so it never takes Worker::mutex.
+ * The fraction is always stored, but the GUI is only notified if
+ * it hasn't been for progress_interval, so a job reporting every
+ * row can't flood the main loop. Results are notified separately
+ * by Worker::finish(), so nothing is lost by skipping a report.
+ *
+ * @param[in] frac the fraction of the job that's done
+ *
+*/
+void Worker::report_progress(double frac) {
+    donefrac.store(frac, std::memory_order_relaxed);
+    loading.store(false, std::memory_order_relaxed);
+
+    long long now = std::chrono::steady_clock::now().time_since_epoch().count();
+    long long last = last_report.load(std::memory_order_relaxed);
+    if (now - last < std::chrono::duration_cast<std::chrono::steady_clock::duration>(progress_interval).count() ||
+        !last_report.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        return; // too soon, or another thread just notified
+    }
+    gui->notify();
+}
+
+/**
+ * Tells the GUI the job is loading, so it can bounce the
+ * GUI::progressbar until Worker::report_progress() has a
+ * fraction to show.
+ *
+*/
+void Worker::report_loading() {
+    loading.store(true, std::memory_order_relaxed);
+    last_report.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    gui->notify();
+}
+
+/**
+ * Tells the GUI the job is playing an animation. There's nothing
+ * left to load and no end to measure progress against, since an
+ * animation can loop forever, so the GUI::progressbar is filled,
+ * and every frame is as finished as the art gets, so it can be
+ * copied and exported while the animation plays.
+ *
+*/
+void Worker::report_playing() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        playing = true;
+        donefrac.store(1.0, std::memory_order_relaxed);
+        loading.store(false, std::memory_order_relaxed);
+    }
+    gui->notify();
+}
+
+/**
+ * Stores what happened while the job played an animation and
+ * tells the GUI about it. Unlike Worker::finish(), it's kept even
+ * if the job was stopped, because being replaced is how most
+ * animations that loop end.
+ *
+ * @param[in] job the job that played the animation
+ * @param[in] stats the frames it showed and dropped, and how long they took
+ *
+*/
+void Worker::report_playback(const Job &job, const PlaybackStats &stats) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        playback = stats;
+        playback_id = job.id;
+    }
+    gui->notify();
+}
+
 /**
  * Sets the fraction of the amount that the 
- * progressbar is filled
+ * progressbar is filled. Both are atomics, so
+ * this never waits for the running job.
  *
  * @param[in,out] donefrac a pointer to the progressbar fraction
+ * @param[in,out] loading a pointer to whether the image is still loading
  *
 */
-void Worker::get_working_data(double *donefrac) const {
-    std::lock_guard<std::mutex> lock(mutex);
+void Worker::get_working_data(double *donefrac, bool *loading) const {
     if (donefrac)
-        *donefrac = this->donefrac;
+        *donefrac = this->donefrac.load(std::memory_order_relaxed);
+    if (loading)
+        *loading = this->loading.load(std::memory_order_relaxed);
+}
+
+/**
+ * Sets the latest art a job made, which may be a
+ * preview, or why it couldn't make any, the ID of
+ * that job, and a number that changes every time
+ * there's a new result. The art is shared, not
+ * copied, and it never changes once it's made.
+ *
+ * @param[in,out] art a pointer to the latest art, empty if there's none
+ * @param[in,out] status a pointer to whether there's art, or why there isn't
+ * @param[in,out] job a pointer to the ID of the job that made it
+ * @param[in,out] revision a pointer to the number of results so far
+ * @return false if no job has finished yet
+ *
+*/
+bool Worker::get_final_data(ArtBuffer *art, ArtStatus *status, unsigned long *job, unsigned long *revision) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (art)
+        *art = this->art;
+    if (status)
+        *status = this->status;
+    if (job)
+        *job = finished_id;
+    if (revision)
+        *revision = this->revision;
+    return finished_id != 0;
 }
 
 /**
- * Sets the final message when the Worker::work()
- * function is finished.
+ * Sets the colored version of the latest art, which
+ * is only made when the job that made the art asked
+ * for color and could get the colors of the image.
  *
- * @param[in,out] message a pointer to the final message
+ * @param[in,out] colored a pointer to the colored text
+ * @param[in,out] mode a pointer to how it's colored
+ * @return false if the latest art isn't colored
  *
 */
-void Worker::get_final_data(Glib::ustring *message) const {
+bool Worker::get_colored_data(ArtBuffer *colored, ColorMode *mode) const {
     std::lock_guard<std::mutex> lock(mutex);
-    if (message)
-        *message = this->message;
+    if (colored)
+        *colored = this->colored;
+    if (mode)
+        *mode = colored_mode;
+    return colored_mode != ColorMode::none;
 }
 
 /**
- * Stops Worker::work() by setting the Worker::will_stop
- * variable to true.
+ * Stops the running job by setting the Worker::will_stop
+ * flag, and drops any job that's waiting.
  *
 */
 void Worker::stop() {
     std::lock_guard<std::mutex> lock(mutex);
-    will_stop = true;
+    pending.reset();
+    cancel_running();
+}
+
+/**
+ * Sets what happened while the last animation played.
+ *
+ * @param[in,out] stats a pointer to the frames it showed and dropped, and how long they took
+ * @param[in,out] job a pointer to the ID of the job that played it
+ * @return false if no job has played an animation
+ *
+*/
+bool Worker::get_playback_stats(PlaybackStats *stats, unsigned long *job) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (playback_id == 0) {
+        return false;
+    }
+    if (stats)
+        *stats = playback;
+    if (job)
+        *job = playback_id;
+    return true;
 }
 
 /**
  * Gets the value of Worker::stopped and returns it
  *
- * @return the value of Worker::stopped
+ * @return whether no job is running or waiting
  *
 */
 bool Worker::has_stopped() const {
@@ -67,3 +451,14 @@ bool Worker::has_stopped() const {
     return stopped;
 }
 
+/**
+ * Gets whether the running job is playing an animation. A
+ * waiting job will replace it, so this is false if there is one.
+ *
+ * @return whether the art on screen is a frame of an animation that's playing
+ *
+*/
+bool Worker::is_playing() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return playing && !pending;
+}
@@ -1,7 +1,18 @@
 #include "settings.hpp"
+#include "cache.hpp"
+#include "sat.hpp"
+#include "threadpool.hpp"
+#include "cancel.hpp"
+#include "glyphs.hpp"
+#include "art.hpp"
+#include "frames.hpp"
+#include <atomic>
+#include <chrono>
 #include <gtkmm.h>
+#include <condition_variable>
 #include <thread>
 #include <mutex>
+#include <optional>
 
 #pragma once
 
@@ -15,31 +26,124 @@ class GUI;
  * 
 */
 
+/**
+ * @brief Everything one conversion needs
+ *
+ * A structure that holds the parameters of one request to
+ * convert an image, including a copy of the settings at the
+ * time it was made, so changing the settings never affects a
+ * conversion that's already running.
+ *
+*/
+struct Job {
+    unsigned long id = 0; ///< The number of the job, counting up from 1
+    std::string filename; ///< The file path to the image to convert
+    float scale_factor = 1; ///< The scale factor to scale the image by
+    int swidth = 0; ///< The width of the screen
+    int sheight = 0; ///< The height of the screen
+    Settings settings; ///< The settings to convert with
+
+    /// A function that returns whether two jobs would make the same text
+    bool same_request(const Job &other) const {
+        return filename == other.filename && scale_factor == other.scale_factor &&
+                swidth == other.swidth && sheight == other.sheight && settings == other.settings;
+    }
+};
+
+/// The longest a job should take to stop after it's told to, in milliseconds
+constexpr double cancel_latency_bound = 100.0;
+
+/// The shortest time between two progress notifications, one frame at 60 frames per second
+constexpr std::chrono::nanoseconds progress_interval(1000000000 / 60);
+
 /**
  * @brief A class to run in a seperate thread and do work
  *
  * A class that holds variables that can be accessed
- * by both threads.
+ * by both threads. It runs one thread for as long as it
+ * exists, which waits for jobs and runs them one at a time.
+ * A new job replaces any job that's waiting and stops the one
+ * that's running, so only the latest request is ever finished.
  *
 */
 class Worker {
     public:
         Worker(); ///< The Worker class constructor, initializes variables
+        ~Worker(); ///< The Worker class destructor, stops the thread
 
-        /// A function to do the conversion from image to ASCII
-        void work(GUI *gui, std::string filename, float scale_factor, int swidth, int sheight, Settings &s);
+        void start(GUI *gui); ///< A function to start the thread, which notifies gui as it works
 
-        void get_working_data(double *donefrac) const; ///< A function to get data while Worker::work() is running
-        void get_final_data(Glib::ustring *message) const; ///< A function to get the resulting text of Worker::work()
-        void stop(); ///< A function to stop Worker::work()
-        bool has_stopped() const; ///< A const function that returns the value of Worker::stopped
+        /// A function to ask for a conversion, returns the ID of the job that will do it
+        unsigned long submit(const std::string &filename, float scale_factor, int swidth, int sheight, const Settings &s);
+
+        /// A function to get data while a job is running, without waiting for the job
+        void get_working_data(double *donefrac, bool *loading) const;
+        /// A function to get the latest art or error a job made, its ID and a number that changes with every new one, false if there's none
+        bool get_final_data(ArtBuffer *art, ArtStatus *status, unsigned long *job, unsigned long *revision) const;
+        /// A function to get the colored version of the latest art and how it's colored, false if it isn't colored
+        bool get_colored_data(ArtBuffer *colored, ColorMode *mode) const;
+        void stop(); ///< A function to stop the running job and drop the waiting one
+        /// A function to get how long the last stopped job and the slowest one took to stop, in milliseconds
+        void get_cancel_latency(double *last, double *worst) const;
+        /// A function to get what happened while the last animation played and the ID of the job that played it, false if none has
+        bool get_playback_stats(PlaybackStats *stats, unsigned long *job) const;
+        bool has_stopped() const; ///< A const function that returns whether no job is running or waiting
+        bool is_playing() const; ///< A const function that returns whether the running job is playing an animation and nothing is waiting
 
     private:
-    
+        void run(); ///< The function the thread runs, which waits for jobs
+        void work(const Job &job); ///< A function to do the conversion from image to ASCII
+        /// A function to hand the art a job made, or a preview of it, to the GUI, with its colored version if there is one
+        void finish(const Job &job, ArtBuffer art, bool preview = false, ArtBuffer colored = nullptr);
+        void fail(const Job &job, ArtStatus status); ///< A function to tell the GUI why a job couldn't make any art
+        void cancel_running(); ///< A function to stop the running job, must be called with Worker::mutex locked
+        void report_progress(double frac); ///< A function to publish progress and notify the GUI, at most once per progress_interval
+        void report_loading(); ///< A function to tell the GUI the job is loading and its progress isn't known yet
+        void report_playing(); ///< A function to tell the GUI the job has started playing an animation
+        /// A function to tell the GUI what happened while the job played an animation, once it's ended or been stopped
+        void report_playback(const Job &job, const PlaybackStats &stats);
+
         mutable std::mutex mutex; ///< A mutex, whatever that is
+        std::condition_variable wake; ///< Wakes the thread when there's a job or it should quit
+        std::thread thread; ///< The thread that runs the jobs
+        GUI *gui; ///< The GUI to notify as jobs run
 
-        bool will_stop; ///< A boolean to alert Worker::work() to stop
+        std::optional<Job> pending; ///< The job waiting to run, if any
+        std::optional<Job> running; ///< The job that's running, if any
+        unsigned long next_id; ///< The ID the next job will get
+        unsigned long finished_id; ///< The ID of the job that made Worker::art, 0 if none has
+        unsigned long revision; ///< Counts the results handed to the GUI
+        bool quit; ///< A boolean to tell the thread to return
+        CancelToken will_stop; ///< A flag to alert Worker::work() to stop, checked without the mutex
+        std::chrono::steady_clock::time_point cancel_time; ///< When the running job was told to stop
+        double last_latency; ///< How long the last stopped job took to stop, in milliseconds
+        double worst_latency; ///< How long the slowest stopped job took to stop, in milliseconds
         bool stopped; ///< A boolean to tell if Worker::work() is stopped
-        double donefrac; ///< The fraction of the GUI::progressbar that's filled
-        Glib::ustring message; ///< The text that Worker::work() returns
+        bool playing; ///< A boolean to tell if Worker::work() is playing an animation, so each frame it shows is final
+        PlaybackStats playback; ///< What happened while the last animation played
+        unsigned long playback_id; ///< The ID of the job that played it, 0 if none has
+        std::atomic<double> donefrac; ///< The fraction of the GUI::progressbar that's filled
+        std::atomic<bool> loading; ///< Whether the job is loading the image and Worker::donefrac isn't known yet
+        std::atomic<long long> last_report; ///< When the GUI was last notified of progress, in steady_clock ticks
+        ArtBuffer art; ///< The art that Worker::work() made, shared with the GUI rather than copied
+        ArtStatus status; ///< Whether Worker::art is there, or why it isn't
+        ArtBuffer colored; ///< Worker::art with the colors of the image, empty if it isn't colored
+        ColorMode colored_mode; ///< How Worker::colored is colored
+        LumCache cache; ///< The cache of images that have already been decoded
+        LumImage image; ///< The luminance values of the last image, kept so changing a setting doesn't decode it again
+        std::string image_filename; ///< The file Worker::image was decoded from, empty if it's not complete
+        FileId image_id; ///< The identity of that file when it was decoded
+        std::string still_filename; ///< The last file that was opened as an animation and turned out to be still
+        FileId still_id; ///< The identity of that file when it was opened, so it's only opened as one again if it changes
+        std::string store_filename; ///< The file Worker::image was just decoded from, saved to Worker::cache after the job, empty if there's nothing to save
+        std::size_t store_budget; ///< The cache budget of the job that decoded it, in bytes
+        bool storing; ///< A boolean to tell if Worker::image is being saved to the cache, which a new job stops
+        SummedAreaTable sat; ///< The summed-area table of Worker::image, built the first time the box filter needs it
+        RgbImage colors; ///< The colors of Worker::image, only decoded once a job asks for color
+        std::string colors_filename; ///< The file Worker::colors was decoded from, empty if it's not complete
+        RgbImage scaled_colors; ///< Worker::colors scaled to the size of the text
+        LumImage scaled; ///< Worker::image scaled by the last job that got that far
+        std::optional<Job> scaled_job; ///< The job Worker::scaled was made for, if it's still valid
+        ThreadPool pool; ///< The threads each stage of a conversion is split across
+        GlyphRamps ramps; ///< The glyph tables for the ramps jobs have used
 };